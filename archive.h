@@ -0,0 +1,185 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+// Packed asset archive. `make resources.pak` runs the pack tool over
+// resources/ and writes every file into one archive: a header, an index
+// sorted by the FNV-1a hash of each path, a table of the paths, then the
+// file contents, each 16-byte aligned and followed by a NUL so text can be
+// used in place. At runtime the archive is mapped once and asset_load hands
+// out pointers straight into the mapping, so loading costs no syscalls.
+// asset_load reads the file from disk instead when there is no archive or
+// it lacks the path, which is also how edited shaders are hot reloaded.
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ARCHIVE_MAGIC 0x4b41504eu // "NPAK"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_ALIGN 16
+
+typedef struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;       // entries in the index, which follows the header
+    uint32_t names_size;  // bytes of NUL-terminated paths after the index
+} ArchiveHeader;
+
+typedef struct ArchiveEntry {
+    uint64_t hash;   // archive_hash of the path
+    uint64_t offset; // of the contents from the start of the file
+    uint64_t size;   // of the contents, without the trailing NUL
+    uint32_t name;   // offset of the path in the name table
+    uint32_t reserved;
+} ArchiveEntry;
+
+typedef struct Archive {
+    const unsigned char* base;
+    size_t size;
+    const ArchiveEntry* entries;
+    const char* names;
+    int count;
+} Archive;
+
+// "./resources/a" and "resources/a" are the same asset
+static const char* archive_path(const char* path) {
+    while (path[0] == '.' && path[1] == '/') path += 2;
+    return path;
+}
+
+uint64_t archive_hash(const char* path) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const char* c = archive_path(path); *c; c++) {
+        h ^= (unsigned char)*c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+bool archive_open(Archive* ar, const char* path) {
+    *ar = (Archive){0};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveHeader)) {
+        close(fd);
+        fprintf(stderr, "Asset archive \"%s\" is truncated\n", path);
+        return false;
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (base == MAP_FAILED) {
+        perror("Asset archive: mmap");
+        return false;
+    }
+
+    const ArchiveHeader* header = base;
+    size_t tables = sizeof(ArchiveHeader) + (size_t)header->count*sizeof(ArchiveEntry) + header->names_size;
+    if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION || tables > (size_t)st.st_size) {
+        fprintf(stderr, "Asset archive \"%s\" is not a version %d archive\n", path, ARCHIVE_VERSION);
+        munmap(base, st.st_size);
+        return false;
+    }
+    ar->base = base;
+    ar->size = st.st_size;
+    ar->count = header->count;
+    ar->entries = (const ArchiveEntry*)(ar->base + sizeof(ArchiveHeader));
+    ar->names = (const char*)(ar->entries + ar->count);
+    for (int i=0; i<ar->count; i++) {
+        const ArchiveEntry* e = &ar->entries[i];
+        if (e->name >= header->names_size || e->offset + e->size >= ar->size) {
+            fprintf(stderr, "Asset archive \"%s\" has a corrupt index\n", path);
+            munmap(base, st.st_size);
+            *ar = (Archive){0};
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* archive_name(const Archive* ar, int index) {
+    return ar->names + ar->entries[index].name;
+}
+
+// entry for path, or NULL. binary search on the hash, then the path to rule out collisions
+const ArchiveEntry* archive_find(const Archive* ar, const char* path) {
+    if (ar == NULL || ar->base == NULL) return NULL;
+    uint64_t h = archive_hash(path);
+    int lo = 0, hi = ar->count;
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (ar->entries[mid].hash < h) lo = mid+1;
+        else hi = mid;
+    }
+    for (; lo < ar->count && ar->entries[lo].hash == h; lo++) {
+        if (strcmp(archive_name(ar, lo), archive_path(path)) == 0) return &ar->entries[lo];
+    }
+    return NULL;
+}
+
+// name of entry index relative to dir if it sits directly in dir, else NULL.
+// used to list a directory of the archive
+const char* archive_dir_entry(const Archive* ar, int index, const char* dir) {
+    const char* name = archive_name(ar, index);
+    dir = archive_path(dir);
+    size_t len = strlen(dir);
+    if (strncmp(name, dir, len) != 0) return NULL;
+    if (len > 0 && dir[len-1] != '/') {
+        if (name[len] != '/') return NULL;
+        len++;
+    }
+    return strchr(name + len, '/') ? NULL : name + len;
+}
+
+void archive_close(Archive* ar) {
+    if (ar->base != NULL) munmap((void*)ar->base, ar->size);
+    *ar = (Archive){0};
+}
+
+// the whole of filepath in a NUL-terminated buffer to free, or NULL
+char* readFile(const char* filepath, size_t* size) {
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    off_t len = lseek(fd, 0, SEEK_END);
+    char* data = len >= 0 ? malloc(len+1) : NULL;
+    if (len >= 0 && data == NULL) abort();
+    if (data == NULL || pread(fd, data, len, 0) != len) {
+        free(data);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    data[len] = '\0';
+    if (size) *size = len;
+    return data;
+}
+
+typedef struct Asset {
+    const char* data; // NUL-terminated
+    size_t size;
+    bool owned;       // read from disk rather than pointing into the archive
+} Asset;
+
+// contents of path from the archive if it has them, else from disk. ar may be NULL
+bool asset_load(const Archive* ar, const char* path, Asset* asset) {
+    const ArchiveEntry* e = archive_find(ar, path);
+    if (e != NULL) {
+        *asset = (Asset){(const char*)ar->base + e->offset, e->size, false};
+        return true;
+    }
+    size_t size;
+    char* data = readFile(path, &size);
+    *asset = (Asset){data, data ? size : 0, data != NULL};
+    return data != NULL;
+}
+
+void asset_release(Asset* asset) {
+    if (asset->owned) free((void*)asset->data);
+    *asset = (Asset){0};
+}
+
+#endif
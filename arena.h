@@ -0,0 +1,77 @@
+#ifndef ARENA_H
+#define ARENA_H
+// Level allocation. An Arena is one block handed out by bumping a pointer and
+// released all at once with arena_reset, so tearing a level down is O(1) no
+// matter how many objects it made. A Pool carves fixed-size slots for one
+// type out of an arena, keeping those objects contiguous. Slots are never
+// freed one by one; they go with the arena.
+#include <stdlib.h>
+#include <stdio.h>
+
+#define ARENA_ALIGN 16
+
+typedef struct Arena {
+    unsigned char* base;
+    size_t size, used;
+} Arena;
+
+typedef struct Pool {
+    unsigned char* slots;
+    size_t slot_size;
+    int capacity, used;
+} Pool;
+
+static inline size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+}
+
+void arena_init(Arena* arena, size_t size) {
+    arena->base = aligned_alloc(ARENA_ALIGN, arena_round(size));
+    if (arena->base == NULL) abort();
+    arena->size = arena_round(size);
+    arena->used = 0;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = arena_round(size);
+    if (arena->used + size > arena->size) {
+        fprintf(stderr, "Arena out of memory: %zu of %zu bytes used, %zu requested\n", arena->used, arena->size, size);
+        abort();
+    }
+    void* p = arena->base + arena->used;
+    arena->used += size;
+    return p;
+}
+
+// forget everything allocated from the arena
+void arena_reset(Arena* arena) {
+    arena->used = 0;
+}
+
+void arena_free(Arena* arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = arena->used = 0;
+}
+
+// arena space needed by a pool of capacity slots
+size_t pool_size(size_t slot_size, int capacity) {
+    return arena_round(arena_round(slot_size)*capacity);
+}
+
+void pool_init(Pool* pool, Arena* arena, size_t slot_size, int capacity) {
+    pool->slot_size = arena_round(slot_size);
+    pool->capacity = capacity;
+    pool->used = 0;
+    pool->slots = arena_alloc(arena, pool->slot_size*capacity);
+}
+
+void* pool_alloc(Pool* pool) {
+    if (pool->used == pool->capacity) {
+        fprintf(stderr, "Pool full: %d slots of %zu bytes\n", pool->capacity, pool->slot_size);
+        abort();
+    }
+    return pool->slots + pool->slot_size*pool->used++;
+}
+
+#endif
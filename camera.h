@@ -0,0 +1,43 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+// View-projection shared by every shader program. It only changes when the
+// framebuffer is resized, so it is computed there and kept in one uniform
+// buffer bound to CAMERA_BINDING; programs declare
+//     layout (std140) uniform Camera { mat4 view_projection; };
+// and are pointed at the binding once with camera_attach.
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+#define CAMERA_BINDING 0
+
+typedef struct Camera {
+    unsigned int UBO;
+    mat4 view_projection;
+} Camera;
+
+void camera_resize(Camera* camera, int width, int height) {
+    glm_ortho_default((float)width/height, camera->view_projection);
+    glBindBuffer(GL_UNIFORM_BUFFER, camera->UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(mat4), camera->view_projection);
+}
+
+void camera_init(Camera* camera, int width, int height) {
+    glGenBuffers(1, &camera->UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, camera->UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, camera->UBO);
+    camera_resize(camera, width, height);
+}
+
+// read the Camera block of program from the shared buffer
+void camera_attach(unsigned int program) {
+    unsigned int block = glGetUniformBlockIndex(program, "Camera");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, CAMERA_BINDING);
+}
+
+void camera_cleanup(Camera* camera) {
+    glDeleteBuffers(1, &camera->UBO);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef FIXED_H
+#define FIXED_H
+// Number type for simulation state. By default this is float; building with
+// -DPONG_FIXED switches it to Q16.16 fixed point, where every operation is
+// integer arithmetic with explicit rounding, so a run is bit-identical across
+// compilers, optimization levels and CPUs (lockstep networking, replay
+// verification). Simulation code uses rmul/rdiv instead of * and / so it
+// reads the same in both modes.
+#include <stdint.h>
+#include <math.h>
+
+#ifdef PONG_FIXED
+
+typedef int32_t real;
+
+#define REAL_ONE 65536
+#define REAL_MAX INT32_MAX
+// constant (or float) to fixed point, rounding half away from zero
+#define REAL(x) ((real)((x)*(double)REAL_ONE + ((x) >= 0 ? 0.5 : -0.5)))
+
+static inline real real_from_float(float f) {
+    return REAL(f);
+}
+
+static inline float real_to_float(real r) {
+    return r/(float)REAL_ONE;
+}
+
+static inline real real_saturate(int64_t v) {
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < INT32_MIN) return INT32_MIN;
+    return (real)v;
+}
+
+// products round toward negative infinity
+static inline real rmul(real a, real b) {
+    int64_t p = (int64_t)a*b;
+    return real_saturate(p >= 0 ? p/REAL_ONE : -((-p + REAL_ONE-1)/REAL_ONE));
+}
+
+// quotients truncate toward zero and saturate, so x/0 acts as +-infinity
+static inline real rdiv(real a, real b) {
+    if (b == 0) return a >= 0 ? INT32_MAX : INT32_MIN;
+    return real_saturate((int64_t)a*REAL_ONE / b);
+}
+
+#else
+
+typedef float real;
+
+#define REAL_ONE 1.0f
+#define REAL_MAX INFINITY
+#define REAL(x) ((float)(x))
+#define real_from_float(f) ((float)(f))
+#define real_to_float(r) ((float)(r))
+#define rmul(a, b) ((a)*(b))
+#define rdiv(a, b) ((a)/(b))
+
+#endif
+
+#endif
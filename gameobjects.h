@@ -1,49 +1,45 @@
 #ifndef GAMEOBJECTS_H
 #define GAMEOBJECTS_H
-#include "shapes.h"
-#include <cglm/cglm.h>
+// Game simulation state and rules. Nothing in here touches GL, so the
+// simulation can run headless; meshes are attached at render time. State is
+// kept in the real type from fixed.h.
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
 
-typedef struct Object {
-    VertexObject* vertobj;
-    float xpos, ypos, rot;
-} Object;
-
-typedef struct MovableObject {
-    VertexObject* vertobj;
-    float xpos, ypos, rot, xvel, yvel, rvel;
-} MovableObject;
+#include "rng.h"
+#include "fixed.h"
+#include "arena.h"
 
 typedef struct Player {
-    VertexObject* vertobj;
-    float xpos, ypos, rot, xvel, yvel, rvel;
+    real xpos, ypos, rot, xvel, yvel, rvel;
     int score;
-    const float width, height;
+    const real width, height;
 } Player;
 
 typedef struct Ball {
-    VertexObject* vertobj;
-    float xpos, ypos, rot, xvel, yvel, rvel;
-    const float size;
+    real xpos, ypos, rot, xvel, yvel, rvel;
+    const real size;
+    uint64_t rng_key;   // this match's random stream, see rng.h
+    unsigned int draws; // numbers taken from it so far
 } Ball;
 
 typedef struct Scoreboard {
     int player1;
     int player2;
-    unsigned long time;
+    unsigned long time; // ticks played
 } Scoreboard;
 
-Player* mkPlayer(float x, float y, float width, float height, vec3 color) {
-    Player player_init = {.width = width, .height = height};
-    Player* player = malloc(sizeof(Player));
-    if (player == NULL) abort();
+Player* mkPlayer(Pool* pool, float x, float y, float width, float height) {
+    Player player_init = {.width = real_from_float(width), .height = real_from_float(height)};
+    Player* player = pool_alloc(pool);
     memcpy(player, &player_init, sizeof *player);
 
-    player->vertobj = colorRect(width, height, color);
-    player->xpos = x;
-    player->ypos = y;
+    player->xpos = real_from_float(x);
+    player->ypos = real_from_float(y);
     player->xvel = 0;
     player->yvel = 0;
     player->score = 0;
@@ -53,99 +49,160 @@ Player* mkPlayer(float x, float y, float width, float height, vec3 color) {
     return player;
 }
 
+// set paddle velocity from a direction: 1 up, -1 down, 0 coast to a stop
+void player_input(Player* p, int dir) {
+    if (dir > 0) {
+        p->yvel = REAL(0.03);
+    } else if (dir < 0) {
+        p->yvel = REAL(-0.03);
+    } else {
+        p->yvel = rmul(p->yvel, REAL(0.9));
+    }
+}
+
+// simple computer player: follow the ball while it is approaching
+int player_track(const Player* p, const Ball* b) {
+    if ((b->xvel > 0) != (p->xpos > b->xpos)) return 0;
+    if (b->ypos > p->ypos + rdiv(p->height, REAL(2.0))) return 1;
+    if (b->ypos < p->ypos - rdiv(p->height, REAL(2.0))) return -1;
+    return 0;
+}
+
 void player_update(Player* p) {
     // movement limit
-    if (p->ypos+p->yvel > 1.0f-(p->height)) {
-        p->yvel = 0.0f;
-        p->ypos = 1.0f-(p->height);
+    if (p->ypos+p->yvel > REAL(1.0)-(p->height)) {
+        p->yvel = 0;
+        p->ypos = REAL(1.0)-(p->height);
         return;
     }
-    if (p->ypos+p->yvel < -1.0f+(p->height)) {
-        p->yvel = 0.0f;
-        p->ypos = -1.0f+(p->height);
+    if (p->ypos+p->yvel < REAL(-1.0)+(p->height)) {
+        p->yvel = 0;
+        p->ypos = REAL(-1.0)+(p->height);
         return;
     }
     p->ypos += p->yvel;
 }
 
-Ball* mkBall(float x, float y, float xv, float yv, float size, vec3 color) {
-    Ball ball_init = {.size = size};
-    Ball* ball = malloc(sizeof(Ball));
-    if (ball == NULL) abort();
+// serve velocities: 0.01 across, and a random [-0.01, 0.01) vertically
+static inline real serve_xvel(bool right) {
+    return right ? REAL(0.01) : REAL(-0.01);
+}
+
+static inline real serve_yvel(uint64_t rng_key, uint64_t n) {
+#ifdef PONG_FIXED
+    // top 17 bits are [0, 2) in Q16.16
+    return (real)((int64_t)(rng_u64(rng_key, n) >> 47) - REAL_ONE) / 100;
+#else
+    return rng_signed(rng_key, n)/100.0f;
+#endif
+}
+
+// put the ball back in the centre, heading the other way at a random angle
+void ball_serve(Ball* b) {
+    b->xpos = 0;
+    b->ypos = 0;
+    b->rot = 0;
+    b->yvel = serve_yvel(b->rng_key, b->draws++);
+    b->xvel = serve_xvel(b->xvel < 0);
+    b->rvel = 0;
+}
+
+// rng_key selects the match's random stream, e.g. rng_key(seed, match id)
+Ball* mkBall(Pool* pool, float x, float y, float size, uint64_t rng_key) {
+    Ball ball_init = {.size = real_from_float(size)};
+    Ball* ball = pool_alloc(pool);
     memcpy(ball, &ball_init, sizeof *ball);
 
-    ball->vertobj = colorRect(size, size, color);
-    ball->xpos = x;
-    ball->ypos = y;
-    ball->xvel = xv;
-    ball->yvel = yv;
+    ball->rng_key = rng_key;
+    ball->draws = 0;
+    ball->xpos = real_from_float(x);
+    ball->ypos = real_from_float(y);
+    ball->xvel = serve_xvel(rng_u64(rng_key, ball->draws++) >> 63);
+    ball->yvel = serve_yvel(rng_key, ball->draws++);
     ball->rot = 0;
     ball->rvel = 0;
 
     return ball;
 }
 
+// Move the ball through one tick. Collisions are swept: the tick is split at
+// each wall or paddle contact, the earliest one is resolved and the ball
+// carries on with the remaining time, so fast balls can't tunnel through a
+// paddle and one step per tick is enough at any speed.
+#define BALL_MAX_EVENTS 4 // bounces resolved per tick; anything after is dropped
+
+enum { BALL_FREE, BALL_WALL, BALL_PADDLE, BALL_GOAL };
+
 void ball_update(Ball* b, Player* p1, Player* p2) {
-    // point to player
-    if (b->xpos+b->xvel > p2->xpos) {
-        b->xpos = 0.0f;
-        b->ypos = 0.0f;
-        b->rot = 0.0f;
-        p1->score += 1;
-        b->yvel = sinf(rand())/100.0f;
-        b->xvel = copysignf(0.01f, -b->xvel);
-        b->rvel = 0.0f;
-        return;
-    }
-    if (b->xpos+b->xvel < p1->xpos) {
-        b->xpos = 0.0f;
-        b->ypos = 0.0f;
-        b->rot = 0.0f;
-        p2->score += 1;
-        b->yvel = sinf(rand())/100.0f;
-        b->xvel = copysignf(0.01f, -b->xvel);
-        b->rvel = 0.0f;
-        return;
+    real damp = REAL(5.0);
+    real top = REAL(1.0)-(b->size), bottom = REAL(-1.0)+(b->size);
+    real t_left = REAL(1.0);
+
+    for (int n=0; n<BALL_MAX_EVENTS; n++) {
+        // time to reach the wall the ball is heading for
+        real t_wall = REAL_MAX;
+        if (b->yvel > 0) t_wall = rdiv(top - b->ypos, b->yvel);
+        else if (b->yvel < 0) t_wall = rdiv(bottom - b->ypos, b->yvel);
+
+        // time to reach the face and goal line of the paddle it is heading for
+        bool right = b->xvel > 0;
+        Player* p = right ? p2 : p1;
+        real face = right ? p2->xpos-(b->size)-(p2->width) : p1->xpos+(b->size)+(p1->width);
+        real t_face = rdiv(face - b->xpos, b->xvel);
+        real t_goal = rdiv(p->xpos - b->xpos, b->xvel);
+        real hit_y = b->ypos + rmul(b->yvel, t_face);
+        bool hit = t_face >= 0 && hit_y < p->ypos+p->height+b->size && hit_y > p->ypos-p->height-b->size;
+
+        // earliest event this tick
+        real t = t_left;
+        int event = BALL_FREE;
+        if (t_wall <= t) { t = t_wall; event = BALL_WALL; }
+        if (hit && t_face <= t) { t = t_face; event = BALL_PADDLE; }
+        if (t_goal < t) { t = t_goal; event = BALL_GOAL; }
+
+        b->xpos += rmul(b->xvel, t);
+        b->ypos += rmul(b->yvel, t);
+        t_left -= t;
+
+        if (event == BALL_FREE) break;
+        if (event == BALL_GOAL) {
+            // point to player
+            if (right) p1->score += 1;
+            else p2->score += 1;
+            ball_serve(b);
+            return;
+        }
+        if (event == BALL_WALL) {
+            // wall bounce
+            b->ypos = b->yvel > 0 ? top : bottom;
+            b->yvel = -b->yvel;
+        } else {
+            // player bounce
+            b->xpos = face;
+            b->xvel = -b->xvel;
+            b->yvel += rdiv(p->yvel, damp);
+            b->rvel += right ? p->yvel : -p->yvel;
+        }
     }
 
-    // wall bounce
-    if (b->ypos+b->yvel > 1.0f-(b->size)) {
-        b->yvel *= -1.0f;
-        b->ypos = 1.0f-(b->size);
-        return;
-    }
-    if (b->ypos+b->yvel < -1.0f+(b->size)) {
-        b->yvel *= -1.0f;
-        b->ypos = -1.0f+(b->size);
-        return;
-    }
+    b->rot += b->rvel;
+}
 
-    float damp = 5.0f;
-    // player bounce
-    if (b->xpos+b->xvel > p2->xpos-(b->size)-(p2->width) &&
-        b->ypos < p2->ypos+p2->height+b->size &&
-        b->ypos > p2->ypos-p2->height-b->size) {
-        b->xvel *= -1.0f;
-        if (b->yvel+p2->yvel/damp < 0.2f || b->yvel+p2->yvel/damp > -0.2f)
-            b->yvel += p2->yvel/damp;
-        if (b->rvel+p2->yvel < 0.8f || b->rvel+p2->yvel > -0.8f)
-            b->rvel += p2->yvel;
-        return;
-    }
-    if (b->xpos+b->xvel < p1->xpos+(b->size)+(p1->width) &&
-        b->ypos < p1->ypos+p1->height+b->size &&
-        b->ypos > p1->ypos-p1->height-b->size) {
-        b->xvel *= -1.0f;
-        if (b->yvel+p1->yvel/damp < 0.2f || b->yvel+p1->yvel/damp > -0.2f)
-            b->yvel += p1->yvel/damp;
-        if (b->rvel+p1->yvel < 0.8f || b->rvel+p1->yvel > -0.8f)
-            b->rvel += -p1->yvel;
-        return;
-    }
+// copy the players' scores onto the scoreboard; true if either changed
+bool scoreboard_update(Scoreboard* sb, Player* p1, Player* p2) {
+    if (sb->player1 == p1->score && sb->player2 == p2->score) return false;
+    sb->player1 = p1->score;
+    sb->player2 = p2->score;
+    return true;
+}
 
-    b->ypos += b->yvel;
-    b->xpos += b->xvel;
-    b->rot  += b->rvel;
+// advance one match by one tick
+void match_update(Player* p1, Player* p2, Ball* b, int p1_dir, int p2_dir) {
+    player_input(p1, p1_dir);
+    player_input(p2, p2_dir);
+    player_update(p1);
+    player_update(p2);
+    ball_update(b, p1, p2);
 }
 
 
@@ -0,0 +1,126 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+// Render state cache. Remembers the bound program, vertex array, texture and
+// polygon mode and drops calls that would set them to what they already
+// are, and caches uniform locations per program so they are looked up once.
+// Anything that binds these behind the cache's back must call
+// glstate_invalidate afterwards.
+#include <glad/glad.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GLSTATE_UNKNOWN 0xFFFFFFFFu
+#define GLSTATE_MAX_UNIFORMS 64
+
+typedef struct GLStats {
+    unsigned int issued, skipped;
+} GLStats;
+
+typedef struct UniformSlot {
+    unsigned int program;
+    const char* name;
+    int location;
+} UniformSlot;
+
+typedef struct GLState {
+    unsigned int program, vertex_array, texture;
+    unsigned int polygon_mode;
+    UniformSlot uniforms[GLSTATE_MAX_UNIFORMS];
+    int uniform_count;
+    GLStats frame;      // calls so far this frame
+    GLStats last_frame; // totals for the previous frame
+} GLState;
+
+GLState glstate = {
+    .program = GLSTATE_UNKNOWN,
+    .vertex_array = GLSTATE_UNKNOWN,
+    .texture = GLSTATE_UNKNOWN,
+    .polygon_mode = GLSTATE_UNKNOWN,
+};
+
+// the loader the context's functions came from (glfwGetProcAddress or
+// eglGetProcAddress), for entry points glad does not load
+GLADloadproc glstate_get_proc;
+
+bool glstate_has_extension(const char* name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i=0; i<count; i++) {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0) return true;
+    }
+    return false;
+}
+
+// forget the bound state, e.g. after code outside the cache changed it
+void glstate_invalidate() {
+    glstate.program = GLSTATE_UNKNOWN;
+    glstate.vertex_array = GLSTATE_UNKNOWN;
+    glstate.texture = GLSTATE_UNKNOWN;
+    glstate.polygon_mode = GLSTATE_UNKNOWN;
+}
+
+void glstate_use_program(unsigned int program) {
+    if (glstate.program == program) { glstate.frame.skipped++; return; }
+    glUseProgram(program);
+    glstate.program = program;
+    glstate.frame.issued++;
+}
+
+void glstate_bind_vertex_array(unsigned int vertex_array) {
+    if (glstate.vertex_array == vertex_array) { glstate.frame.skipped++; return; }
+    glBindVertexArray(vertex_array);
+    glstate.vertex_array = vertex_array;
+    glstate.frame.issued++;
+}
+
+// GL_TEXTURE_2D on the active texture unit
+void glstate_bind_texture(unsigned int texture) {
+    if (glstate.texture == texture) { glstate.frame.skipped++; return; }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glstate.texture = texture;
+    glstate.frame.issued++;
+}
+
+void glstate_polygon_mode(unsigned int mode) {
+    if (glstate.polygon_mode == mode) { glstate.frame.skipped++; return; }
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    glstate.polygon_mode = mode;
+    glstate.frame.issued++;
+}
+
+// location of a uniform, queried from GL only the first time per program.
+// name is kept, not copied, so pass a string literal
+int glstate_uniform_location(unsigned int program, const char* name) {
+    for (int i=0; i<glstate.uniform_count; i++) {
+        UniformSlot* slot = &glstate.uniforms[i];
+        if (slot->program == program && (slot->name == name || strcmp(slot->name, name) == 0)) {
+            glstate.frame.skipped++;
+            return slot->location;
+        }
+    }
+    int location = glGetUniformLocation(program, name);
+    glstate.frame.issued++;
+    if (glstate.uniform_count < GLSTATE_MAX_UNIFORMS) {
+        glstate.uniforms[glstate.uniform_count++] = (UniformSlot){program, name, location};
+    }
+    return location;
+}
+
+// drop cached locations of a program that is about to be deleted or relinked
+void glstate_forget_program(unsigned int program) {
+    int kept = 0;
+    for (int i=0; i<glstate.uniform_count; i++) {
+        if (glstate.uniforms[i].program != program) glstate.uniforms[kept++] = glstate.uniforms[i];
+    }
+    glstate.uniform_count = kept;
+    if (glstate.program == program) glstate.program = GLSTATE_UNKNOWN;
+}
+
+// close the frame's counters, readable afterwards in glstate.last_frame
+void glstate_end_frame() {
+    glstate.last_frame = glstate.frame;
+    glstate.frame = (GLStats){0, 0};
+}
+
+#endif
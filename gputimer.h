@@ -0,0 +1,143 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+// Per-pass GPU timing. Each pass of a frame is wrapped in a GL_TIME_ELAPSED
+// query and its CPU submission time is measured alongside. Queries live in
+// a ring of GPU_TIMER_FRAMES frames and a frame's results are read when its
+// slot comes round again, by which time the GPU has long finished it, so
+// reading them does not stall. A pass with high CPU time is submission or
+// driver overhead; high GPU time is the GPU itself.
+//
+// Only one time query can run at once, so passes follow each other and
+// never nest; beginning a pass ends the previous one.
+#include <glad/glad.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define GPU_TIMER_FRAMES 4 // frames of queries in flight
+#define GPU_TIMER_PASSES 8 // distinct passes, and passes per frame
+
+typedef struct GpuPass {
+    const char* name;
+    double gpu_ms, cpu_ms;       // latest frame with results
+    double gpu_total, cpu_total; // for averages
+    unsigned long samples;
+} GpuPass;
+
+typedef struct GpuTimerFrame {
+    unsigned int queries[GPU_TIMER_PASSES];
+    int passes[GPU_TIMER_PASSES]; // index into GpuTimer.passes
+    double cpu_ms[GPU_TIMER_PASSES];
+    int count;
+} GpuTimerFrame;
+
+typedef struct GpuTimer {
+    GpuTimerFrame frames[GPU_TIMER_FRAMES];
+    int current; // frame being recorded
+    int open;    // pass of the current frame whose query is running, -1 when none
+    double cpu_start;
+    GpuPass passes[GPU_TIMER_PASSES];
+    int pass_count;
+    unsigned int stalls; // results that were not ready when their slot came round
+    unsigned long collected; // frames read back so far
+} GpuTimer;
+
+static double gpu_timer_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+void gpu_timer_init(GpuTimer* t) {
+    *t = (GpuTimer){.open = -1};
+    for (int i=0; i<GPU_TIMER_FRAMES; i++) glGenQueries(GPU_TIMER_PASSES, t->frames[i].queries);
+}
+
+// pass named name, added the first time it is seen. names are compared by
+// content, so string literals are fine
+static int gpu_timer_pass(GpuTimer* t, const char* name) {
+    for (int i=0; i<t->pass_count; i++) {
+        if (strcmp(t->passes[i].name, name) == 0) return i;
+    }
+    if (t->pass_count == GPU_TIMER_PASSES) return -1;
+    t->passes[t->pass_count] = (GpuPass){.name = name};
+    return t->pass_count++;
+}
+
+void gpu_timer_end(GpuTimer* t) {
+    if (t->open < 0) return;
+    GpuTimerFrame* f = &t->frames[t->current];
+    glEndQuery(GL_TIME_ELAPSED);
+    f->cpu_ms[t->open] = gpu_timer_clock_ms() - t->cpu_start;
+    t->open = -1;
+}
+
+void gpu_timer_begin(GpuTimer* t, const char* name) {
+    gpu_timer_end(t);
+    GpuTimerFrame* f = &t->frames[t->current];
+    int pass = gpu_timer_pass(t, name);
+    if (pass < 0 || f->count == GPU_TIMER_PASSES) return;
+    t->open = f->count++;
+    f->passes[t->open] = pass;
+    t->cpu_start = gpu_timer_clock_ms();
+    glBeginQuery(GL_TIME_ELAPSED, f->queries[t->open]);
+}
+
+// read a recorded frame's results into the passes and free its slot
+static void gpu_timer_collect(GpuTimer* t, GpuTimerFrame* f) {
+    if (f->count == 0) return;
+    int available = 0;
+    glGetQueryObjectiv(f->queries[f->count-1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) t->stalls++; // the reads below wait
+    // the first frame carries driver warm-up, and llvmpipe reports a bogus
+    // time for its first query
+    for (int i=0; i<f->count && t->collected > 0; i++) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(f->queries[i], GL_QUERY_RESULT, &ns);
+        GpuPass* pass = &t->passes[f->passes[i]];
+        pass->gpu_ms = ns/1e6;
+        pass->cpu_ms = f->cpu_ms[i];
+        pass->gpu_total += pass->gpu_ms;
+        pass->cpu_total += pass->cpu_ms;
+        pass->samples++;
+    }
+    f->count = 0;
+    t->collected++;
+}
+
+// close the frame and collect the oldest one in the ring
+void gpu_timer_end_frame(GpuTimer* t) {
+    gpu_timer_end(t);
+    t->current = (t->current+1) % GPU_TIMER_FRAMES;
+    gpu_timer_collect(t, &t->frames[t->current]);
+}
+
+// latest results as "name gpu/cpu" pairs in milliseconds
+void gpu_timer_format(GpuTimer* t, char* out, size_t size) {
+    size_t n = snprintf(out, size, "gpu/cpu ms:");
+    for (int i=0; i<t->pass_count && n < size; i++) {
+        GpuPass* p = &t->passes[i];
+        n += snprintf(out+n, size-n, " %s %.2f/%.2f", p->name, p->gpu_ms, p->cpu_ms);
+    }
+}
+
+// averages over every collected frame
+void gpu_timer_report(GpuTimer* t, FILE* out) {
+    fprintf(out, "%-10s %10s %10s %8s\n", "pass", "gpu ms", "cpu ms", "frames");
+    for (int i=0; i<t->pass_count; i++) {
+        GpuPass* p = &t->passes[i];
+        if (p->samples == 0) continue;
+        fprintf(out, "%-10s %10.3f %10.3f %8lu\n", p->name, p->gpu_total/p->samples,
+                p->cpu_total/p->samples, p->samples);
+    }
+    if (t->stalls) fprintf(out, "%u frames waited for their timings\n", t->stalls);
+}
+
+void gpu_timer_cleanup(GpuTimer* t) {
+    gpu_timer_end(t);
+    for (int i=0; i<GPU_TIMER_FRAMES; i++) glDeleteQueries(GPU_TIMER_PASSES, t->frames[i].queries);
+}
+
+#endif
@@ -0,0 +1,240 @@
+// Runs computer-vs-computer matches without a window or GL context, as fast as
+// the CPU allows. Useful for benchmarking and soaking the game rules.
+//
+// usage: pong-headless [-m matches] [-t ticks] [-s seed] [-k kernel] [-c]
+//                      [-j threads] [-b shard size] [-d seconds]
+//
+// kernels: objects, batch (best for this CPU), scalar, sse, avx2
+// -j shards batch kernels across threads with the work-stealing runner;
+//    -j 0 uses every online CPU
+// -d gives the runner a wall-clock budget; it stops when the budget runs
+//    out even if matches are short of -t ticks
+// -c replays the run with the scalar batch kernel and checks that the
+//    selected kernel produced bit-identical state; for objects, which keeps
+//    no batch, the state hashes are compared. `make check` runs these
+//
+// exit status: 0 ok, 1 bad arguments, 2 check mismatch, 3 kernel not
+// available on this CPU or in this build
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "gameobjects.h"
+#include "matches.h"
+#include "runner.h"
+
+typedef struct Match {
+    Player* player1;
+    Player* player2;
+    Ball* ball;
+} Match;
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// FNV-1a over one match's state, for comparing runs across builds and machines
+uint64_t hash_match(uint64_t h, const real state[10], int score1, int score2) {
+    unsigned char bytes[10*sizeof(real) + 2*sizeof(int)];
+    memcpy(bytes, state, 10*sizeof(real));
+    memcpy(bytes + 10*sizeof(real), &score1, sizeof(int));
+    memcpy(bytes + 10*sizeof(real) + sizeof(int), &score2, sizeof(int));
+    for (size_t i=0; i<sizeof bytes; i++) {
+        h = (h ^ bytes[i]) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+#define HASH_INIT 0xCBF29CE484222325ull
+
+// one pooled Player/Ball set per match, stepped one match at a time
+long run_objects(int match_count, long ticks, uint64_t seed, double* elapsed, uint64_t* hash) {
+    Arena arena;
+    Pool players, balls;
+    arena_init(&arena, match_count*sizeof(Match) + pool_size(sizeof(Player), 2*match_count) +
+                       pool_size(sizeof(Ball), match_count));
+    pool_init(&players, &arena, sizeof(Player), 2*match_count);
+    pool_init(&balls, &arena, sizeof(Ball), match_count);
+
+    Match* matches = arena_alloc(&arena, match_count*sizeof(Match));
+    for (int i=0; i<match_count; i++) {
+        matches[i].player1 = mkPlayer(&players, -0.95f, 0.0f, 0.02f, 0.25f);
+        matches[i].player2 = mkPlayer(&players, 0.95f, 0.0f, 0.02f, 0.25f);
+        matches[i].ball = mkBall(&balls, 0.0f, 0.0f, 0.02f, rng_key(seed, i));
+    }
+
+    double start = now();
+    for (int i=0; i<match_count; i++) {
+        Match* m = &matches[i];
+        for (long t=0; t<ticks; t++) {
+            match_update(m->player1, m->player2, m->ball,
+                         player_track(m->player1, m->ball),
+                         player_track(m->player2, m->ball));
+        }
+    }
+    *elapsed = now() - start;
+
+    long points = 0;
+    *hash = HASH_INIT;
+    for (int i=0; i<match_count; i++) {
+        Match* m = &matches[i];
+        real state[] = {m->ball->xpos, m->ball->ypos, m->ball->rot, m->ball->xvel, m->ball->yvel,
+                        m->ball->rvel, m->player1->ypos, m->player1->yvel, m->player2->ypos, m->player2->yvel};
+        *hash = hash_match(*hash, state, m->player1->score, m->player2->score);
+        points += matches[i].player1->score + matches[i].player2->score;
+    }
+    arena_free(&arena);
+    return points;
+}
+
+// all matches in one structure-of-arrays batch, stepped one tick at a time
+MatchBatch* run_batch(BatchKernel kernel, int match_count, long ticks, uint64_t seed, double* elapsed) {
+    MatchBatch* mb = mkMatchBatch(match_count, seed);
+
+    double start = now();
+    for (long t=0; t<ticks; t++) {
+        kernel(mb, NULL, 0, mb->count);
+    }
+    *elapsed = now() - start;
+    return mb;
+}
+
+BatchKernel find_kernel(const char* name) {
+    if (strcmp(name, "batch") == 0) return batch_kernel();
+    if (strcmp(name, "scalar") == 0) return batch_step_scalar;
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(PONG_FIXED)
+    if (strcmp(name, "sse") == 0 && __builtin_cpu_supports("sse4.1")) return batch_step_sse;
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return batch_step_avx2;
+#endif
+    return NULL;
+}
+
+// state hash and points scored over every match in a batch, as run_objects computes them
+uint64_t batch_hash(MatchBatch* mb, long* points) {
+    uint64_t hash = HASH_INIT;
+    *points = 0;
+    for (int i=0; i<mb->count; i++) {
+        real state[] = {mb->ball_x[i], mb->ball_y[i], mb->ball_rot[i], mb->ball_xvel[i], mb->ball_yvel[i],
+                        mb->ball_rvel[i], mb->p1_y[i], mb->p1_yvel[i], mb->p2_y[i], mb->p2_yvel[i]};
+        hash = hash_match(hash, state, mb->p1_score[i], mb->p2_score[i]);
+        *points += mb->p1_score[i] + mb->p2_score[i];
+    }
+    return hash;
+}
+
+// compare two batches bit for bit, returning the number of differing matches
+int batch_diff(MatchBatch* a, MatchBatch* b) {
+    int diffs = 0;
+    for (int i=0; i<a->count; i++) {
+        real fa[] = {a->ball_x[i], a->ball_y[i], a->ball_rot[i], a->ball_xvel[i], a->ball_yvel[i],
+                      a->ball_rvel[i], a->p1_y[i], a->p1_yvel[i], a->p2_y[i], a->p2_yvel[i]};
+        real fb[] = {b->ball_x[i], b->ball_y[i], b->ball_rot[i], b->ball_xvel[i], b->ball_yvel[i],
+                      b->ball_rvel[i], b->p1_y[i], b->p1_yvel[i], b->p2_y[i], b->p2_yvel[i]};
+        if (memcmp(fa, fb, sizeof fa) != 0 ||
+            a->p1_score[i] != b->p1_score[i] || a->p2_score[i] != b->p2_score[i]) {
+            diffs++;
+        }
+    }
+    return diffs;
+}
+
+int main(int argc, char** argv) {
+    int match_count = 1000;
+    long ticks = 10000;
+    uint64_t seed = time(0);
+    const char* kernel = "batch";
+    bool check = false;
+    int threads = -1;
+    int shard_size = 256;
+    double budget = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:t:s:k:cj:b:d:")) != -1) {
+        switch (opt) {
+            case 'm': match_count = atoi(optarg); break;
+            case 't': ticks = atol(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'k': kernel = optarg; break;
+            case 'c': check = true; break;
+            case 'j': threads = atoi(optarg); break;
+            case 'b': shard_size = atoi(optarg); break;
+            case 'd': budget = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-m matches] [-t ticks] [-s seed] [-k kernel] [-c] [-j threads] [-b shard size] [-d seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (budget > 0 && (threads < 0 || check)) {
+        fprintf(stderr, "-d needs -j and can't be combined with -c\n");
+        return 1;
+    }
+    if (match_count <= 0 || ticks <= 0) {
+        fprintf(stderr, "matches and ticks must be positive\n");
+        return 1;
+    }
+    long points = 0;
+    double elapsed;
+    double total = (double)match_count*ticks; // match ticks stepped
+    uint64_t hash = HASH_INIT;
+    if (strcmp(kernel, "objects") == 0) {
+        if (threads >= 0) {
+            fprintf(stderr, "the objects kernel is single threaded\n");
+            return 1;
+        }
+        points = run_objects(match_count, ticks, seed, &elapsed, &hash);
+
+        if (check) {
+            double ref_elapsed;
+            long ref_points;
+            MatchBatch* ref = run_batch(batch_step_scalar, match_count, ticks, seed, &ref_elapsed);
+            uint64_t ref_hash = batch_hash(ref, &ref_points);
+            freeMatchBatch(ref);
+            printf("check against scalar: state hashes %s\n", ref_hash == hash ? "match" : "differ");
+            if (ref_hash != hash) return 2;
+        }
+    } else {
+        BatchKernel kernel_fn = find_kernel(kernel);
+        if (kernel_fn == NULL) {
+            if (strcmp(kernel, "sse") == 0 || strcmp(kernel, "avx2") == 0) {
+                fprintf(stderr, "kernel \"%s\" is not available on this CPU or in this build\n", kernel);
+                return 3;
+            }
+            fprintf(stderr, "unknown kernel \"%s\"\n", kernel);
+            return 1;
+        }
+        MatchBatch* mb;
+        if (threads >= 0) {
+            mb = mkMatchBatch(match_count, seed);
+            Runner* r = runMatches(mb, kernel_fn, ticks, budget, threads, shard_size);
+            elapsed = r->wall;
+            total = runner_match_ticks(r);
+            runner_report(r, stdout);
+            freeRunner(r);
+        } else {
+            mb = run_batch(kernel_fn, match_count, ticks, seed, &elapsed);
+        }
+        hash = batch_hash(mb, &points);
+
+        if (check) {
+            double ref_elapsed;
+            MatchBatch* ref = run_batch(batch_step_scalar, match_count, ticks, seed, &ref_elapsed);
+            int diffs = batch_diff(mb, ref);
+            printf("check against scalar: %d of %d matches differ\n", diffs, match_count);
+            freeMatchBatch(ref);
+            if (diffs) {
+                freeMatchBatch(mb);
+                return 2;
+            }
+        }
+        freeMatchBatch(mb);
+    }
+
+    printf("%s: %d matches x %ld ticks in %.3fs: %.2f Mticks/s, %ld points scored, state %016llx\n",
+           kernel, match_count, ticks, elapsed, total/elapsed/1e6, points, (unsigned long long)hash);
+    return 0;
+}
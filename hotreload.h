@@ -0,0 +1,167 @@
+#ifndef HOTRELOAD_H
+#define HOTRELOAD_H
+// Shader hot reload. A worker thread watches the shader library's directory
+// with inotify and, when a file is written, rebuilds the program named by its
+// base name on a hidden window whose GL context shares objects with the main
+// one. The finished program is handed over through an atomic slot and
+// hotreload_swap puts it in place at the next frame boundary, so the render
+// loop never waits for a compile. A program that fails to build is dropped
+// and the old one stays.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "shader.h"
+#include "glstate.h"
+
+#define HOT_DEBOUNCE_MS 50 // editors write a file in several steps
+
+typedef struct HotReload {
+    ShaderLibrary* library;
+    _Atomic unsigned int* pending; // per program: rebuilt and waiting to be swapped in, or 0
+    GLFWwindow* context; // hidden, shares objects with the main window
+    pthread_t thread;
+    int inotify, watch;
+    atomic_bool running;
+    void (*on_swap)(unsigned int program); // e.g. to bind uniform blocks
+} HotReload;
+
+// rebuild the dirty programs together and hand them to the render thread
+static void hotreload_build(HotReload* hr, bool* dirty) {
+    ShaderLibrary* lib = hr->library;
+    if (lib->count == 0) return;
+    ShaderProgram programs[lib->count];
+    int index[lib->count], count = 0;
+    for (int i=0; i<lib->count; i++) {
+        if (!dirty[i]) continue;
+        // name and files are never written after load; program belongs to the render thread
+        ShaderProgram* sp = &lib->programs[i];
+        programs[count] = (ShaderProgram){.name = sp->name, .files = sp->files, .file_count = sp->file_count};
+        index[count++] = i;
+    }
+    if (count == 0) return;
+
+    unsigned int built[count];
+    ShaderTiming timings[count];
+    // edited files are on disk, whether or not the library came from the archive
+    buildPrograms(NULL, lib->dir, programs, count, lib->parallel, built, timings);
+    glFinish(); // complete before the render thread can see them
+    for (int i=0; i<count; i++) {
+        if (built[i] == 0) {
+            fprintf(stderr, "Hot reload: \"%s\" failed to build, keeping the previous program\n", programs[i].name);
+            continue;
+        }
+        unsigned int stale = atomic_exchange(&hr->pending[index[i]], built[i]);
+        if (stale != 0) glDeleteProgram(stale); // never swapped in
+        printf("Reloaded shader \"%s\" in %.2f ms\n", programs[i].name, timings[i].ready_ms);
+    }
+}
+
+static void* hotreload_worker(void* arg) {
+    HotReload* hr = arg;
+    glfwMakeContextCurrent(hr->context);
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = {hr->inotify, POLLIN, 0};
+    while (atomic_load(&hr->running)) {
+        if (poll(&pfd, 1, 100) <= 0) continue;
+
+        // collect every event of a burst before building anything
+        bool dirty[hr->library->count];
+        memset(dirty, 0, sizeof(dirty));
+        do {
+            ssize_t len = read(hr->inotify, buf, sizeof(buf));
+            for (char* p = buf; len > 0 && p < buf + len; ) {
+                struct inotify_event* ev = (struct inotify_event*)p;
+                if (ev->len && shaderType(ev->name) != 0) {
+                    char* name = strndup(ev->name, strcspn(ev->name, "."));
+                    ShaderProgram* sp = shader_find(hr->library, name);
+                    if (sp != NULL) dirty[sp - hr->library->programs] = true;
+                    free(name);
+                }
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        } while (poll(&pfd, 1, HOT_DEBOUNCE_MS) > 0);
+
+        hotreload_build(hr, dirty);
+    }
+
+    glfwMakeContextCurrent(NULL);
+    return NULL;
+}
+
+// create the shared context and start watching library. call on the main
+// thread. a shader file added later only counts if its program already exists
+bool hotreload_start(HotReload* hr, ShaderLibrary* library, GLFWwindow* window) {
+    hr->library = library;
+    hr->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hr->inotify < 0) {
+        perror("Hot reload: inotify_init1");
+        return false;
+    }
+    hr->watch = inotify_add_watch(hr->inotify, library->dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (hr->watch < 0) {
+        fprintf(stderr, "Hot reload: cannot watch \"%s\"\n", library->dir);
+        close(hr->inotify);
+        return false;
+    }
+    hr->pending = calloc(library->count ? library->count : 1, sizeof(*hr->pending));
+    if (hr->pending == NULL) abort();
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    hr->context = glfwCreateWindow(1, 1, "", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (hr->context == NULL) {
+        fprintf(stderr, "Hot reload: failed to create a shared context\n");
+        close(hr->inotify);
+        free(hr->pending);
+        return false;
+    }
+
+    atomic_init(&hr->running, true);
+    if (pthread_create(&hr->thread, NULL, hotreload_worker, hr) != 0) {
+        glfwDestroyWindow(hr->context);
+        close(hr->inotify);
+        free(hr->pending);
+        return false;
+    }
+    return true;
+}
+
+// put rebuilt programs in place; call between frames on the render thread
+int hotreload_swap(HotReload* hr) {
+    int swapped = 0;
+    for (int i=0; i<hr->library->count; i++) {
+        ShaderProgram* sp = &hr->library->programs[i];
+        unsigned int program = atomic_exchange(&hr->pending[i], 0);
+        if (program == 0) continue;
+        glstate_forget_program(sp->program);
+        glDeleteProgram(sp->program);
+        sp->program = program;
+        if (hr->on_swap) hr->on_swap(program);
+        swapped++;
+    }
+    return swapped;
+}
+
+void hotreload_stop(HotReload* hr) {
+    atomic_store(&hr->running, false);
+    pthread_join(hr->thread, NULL);
+    for (int i=0; i<hr->library->count; i++) {
+        unsigned int program = atomic_exchange(&hr->pending[i], 0);
+        if (program != 0) glDeleteProgram(program);
+    }
+    free(hr->pending);
+    glfwDestroyWindow(hr->context);
+    close(hr->inotify);
+}
+
+#endif
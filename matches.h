@@ -0,0 +1,257 @@
+#ifndef MATCHES_H
+#define MATCHES_H
+// Structure-of-arrays simulator for many concurrent matches. Every match in a
+// batch shares the court geometry of the windowed game; per-match state lives
+// in parallel arrays so a step is a linear sweep with no pointer chasing. The
+// rules are the same as player_update/ball_update in gameobjects.h. The SIMD
+// kernels are float only; fixed-point builds use the scalar kernel.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rng.h"
+#include "gameobjects.h"
+
+#define BATCH_ALIGN 32 // bytes, and every array is padded to a multiple of 8 lanes
+
+typedef struct MatchBatch {
+    int count;
+
+    // court geometry shared by every match
+    real p1_x, p2_x;
+    real paddle_width, paddle_height;
+    real ball_size;
+
+    // per-match state
+    real *ball_x, *ball_y, *ball_rot;
+    real *ball_xvel, *ball_yvel, *ball_rvel;
+    real *p1_y, *p1_yvel;
+    real *p2_y, *p2_yvel;
+    int *p1_score, *p2_score;
+    unsigned int* draws; // numbers taken from each match's random stream
+
+    uint64_t seed; // match i draws from rng_key(seed, i)
+    void* mem;
+} MatchBatch;
+
+void batch_serve(MatchBatch* mb, int i) {
+    mb->ball_x[i] = 0;
+    mb->ball_y[i] = 0;
+    mb->ball_rot[i] = 0;
+    mb->ball_yvel[i] = serve_yvel(rng_key(mb->seed, i), mb->draws[i]++);
+    mb->ball_xvel[i] = serve_xvel(mb->ball_xvel[i] < 0);
+    mb->ball_rvel[i] = 0;
+}
+
+// start match i over: scores cleared, paddles centred and the same kind of
+// opening serve as mkBall. the match keeps drawing from its random stream,
+// so every restart is different but still reproducible
+void batch_reset(MatchBatch* mb, int i) {
+    uint64_t key = rng_key(mb->seed, i);
+    mb->p1_y[i] = 0; mb->p1_yvel[i] = 0; mb->p1_score[i] = 0;
+    mb->p2_y[i] = 0; mb->p2_yvel[i] = 0; mb->p2_score[i] = 0;
+    mb->ball_x[i] = 0;
+    mb->ball_y[i] = 0;
+    mb->ball_rot[i] = 0;
+    mb->ball_xvel[i] = serve_xvel(rng_u64(key, mb->draws[i]++) >> 63);
+    mb->ball_yvel[i] = serve_yvel(key, mb->draws[i]++);
+    mb->ball_rvel[i] = 0;
+}
+
+// set up count matches in mb; false, with nothing allocated, when the
+// arrays don't fit in memory
+bool batch_init(MatchBatch* mb, int count, uint64_t seed) {
+    *mb = (MatchBatch){0};
+    size_t padded = ((size_t)count+7) & ~(size_t)7;
+    size_t array = padded*sizeof(real);
+    if (count <= 0 || padded > SIZE_MAX/sizeof(real)/13) return false;
+    mb->mem = aligned_alloc(BATCH_ALIGN, 13*array);
+    if (mb->mem == NULL) return false;
+    memset(mb->mem, 0, 13*array);
+
+    char* p = mb->mem;
+    real** reals[] = {
+        &mb->ball_x, &mb->ball_y, &mb->ball_rot,
+        &mb->ball_xvel, &mb->ball_yvel, &mb->ball_rvel,
+        &mb->p1_y, &mb->p1_yvel, &mb->p2_y, &mb->p2_yvel,
+    };
+    for (int a=0; a<10; a++, p+=array) *reals[a] = (real*)p;
+    mb->p1_score = (int*)p; p += array;
+    mb->p2_score = (int*)p; p += array;
+    mb->draws = (unsigned int*)p;
+
+    mb->count = count;
+    mb->seed = seed;
+    mb->p1_x = real_from_float(-0.95f);
+    mb->p2_x = real_from_float(0.95f);
+    mb->paddle_width = real_from_float(0.02f);
+    mb->paddle_height = real_from_float(0.25f);
+    mb->ball_size = real_from_float(0.02f);
+
+    for (int i=0; i<count; i++) {
+        batch_reset(mb, i);
+    }
+    return true;
+}
+
+// free the arrays of a batch set up with batch_init
+void batch_release(MatchBatch* mb) {
+    free(mb->mem);
+    mb->mem = NULL;
+}
+
+MatchBatch* mkMatchBatch(int count, uint64_t seed) {
+    MatchBatch* mb = malloc(sizeof(MatchBatch));
+    if (mb == NULL || !batch_init(mb, count, seed)) abort();
+    return mb;
+}
+
+void freeMatchBatch(MatchBatch* mb) {
+    batch_release(mb);
+    free(mb);
+}
+
+// same as player_input and player_update for one paddle
+static inline void batch_paddle(real* y, real* yvel, int dir, real height) {
+    real v = *yvel;
+    if (dir > 0) {
+        v = REAL(0.03);
+    } else if (dir < 0) {
+        v = REAL(-0.03);
+    } else {
+        v = rmul(v, REAL(0.9));
+    }
+
+    // movement limit
+    if (*y+v > REAL(1.0)-height) {
+        *yvel = 0;
+        *y = REAL(1.0)-height;
+    } else if (*y+v < REAL(-1.0)+height) {
+        *yvel = 0;
+        *y = REAL(-1.0)+height;
+    } else {
+        *yvel = v;
+        *y += v;
+    }
+}
+
+// same as player_track
+static inline int batch_track(real px, real py, real height, real bx, real by, real bxvel) {
+    if ((bxvel > 0) != (px > bx)) return 0;
+    if (by > py + rdiv(height, REAL(2.0))) return 1;
+    if (by < py - rdiv(height, REAL(2.0))) return -1;
+    return 0;
+}
+
+// step matches [first, last) by one tick. actions holds two directions per
+// match (player 1, player 2); NULL lets the computer play both sides.
+void batch_step_scalar(MatchBatch* mb, const signed char* actions, int first, int last) {
+    const real size = mb->ball_size;
+    const real w = mb->paddle_width, h = mb->paddle_height;
+    const real p1x = mb->p1_x, p2x = mb->p2_x;
+    const real damp = REAL(5.0);
+
+    for (int i=first; i<last; i++) {
+        real x = mb->ball_x[i], y = mb->ball_y[i], rot = mb->ball_rot[i];
+        real xvel = mb->ball_xvel[i], yvel = mb->ball_yvel[i], rvel = mb->ball_rvel[i];
+        real p1y = mb->p1_y[i], p1yvel = mb->p1_yvel[i];
+        real p2y = mb->p2_y[i], p2yvel = mb->p2_yvel[i];
+
+        int d1, d2;
+        if (actions) {
+            d1 = actions[2*i];
+            d2 = actions[2*i+1];
+        } else {
+            d1 = batch_track(p1x, p1y, h, x, y, xvel);
+            d2 = batch_track(p2x, p2y, h, x, y, xvel);
+        }
+        batch_paddle(&p1y, &p1yvel, d1, h);
+        batch_paddle(&p2y, &p2yvel, d2, h);
+        mb->p1_y[i] = p1y; mb->p1_yvel[i] = p1yvel;
+        mb->p2_y[i] = p2y; mb->p2_yvel[i] = p2yvel;
+
+        // same as ball_update
+        const real top = REAL(1.0)-size, bottom = REAL(-1.0)+size;
+        const real face2 = p2x-size-w, face1 = p1x+size+w;
+        real t_left = REAL(1.0);
+        int goal = 0;
+        for (int n=0; n<BALL_MAX_EVENTS; n++) {
+            real t_wall = REAL_MAX;
+            if (yvel > 0) t_wall = rdiv(top - y, yvel);
+            else if (yvel < 0) t_wall = rdiv(bottom - y, yvel);
+
+            bool right = xvel > 0;
+            real face = right ? face2 : face1;
+            real py = right ? p2y : p1y;
+            real t_face = rdiv(face - x, xvel);
+            real t_goal = rdiv((right ? p2x : p1x) - x, xvel);
+            real hit_y = y + rmul(yvel, t_face);
+            bool hit = t_face >= 0 && hit_y < py+h+size && hit_y > py-h-size;
+
+            real t = t_left;
+            int event = BALL_FREE;
+            if (t_wall <= t) { t = t_wall; event = BALL_WALL; }
+            if (hit && t_face <= t) { t = t_face; event = BALL_PADDLE; }
+            if (t_goal < t) { t = t_goal; event = BALL_GOAL; }
+
+            x = x + rmul(xvel, t);
+            y = y + rmul(yvel, t);
+            t_left -= t;
+
+            if (event == BALL_FREE) break;
+            if (event == BALL_GOAL) {
+                goal = right ? 1 : 2;
+                break;
+            }
+            if (event == BALL_WALL) {
+                y = yvel > 0 ? top : bottom;
+                yvel = -yvel;
+            } else {
+                x = face;
+                xvel = -xvel;
+                yvel += rdiv(right ? p2yvel : p1yvel, damp);
+                rvel += right ? p2yvel : -p1yvel;
+            }
+        }
+
+        if (goal) {
+            // point to player
+            if (goal == 1) mb->p1_score[i] += 1;
+            else mb->p2_score[i] += 1;
+            mb->ball_xvel[i] = xvel;
+            batch_serve(mb, i);
+            continue;
+        }
+        rot += rvel;
+
+        mb->ball_x[i] = x; mb->ball_y[i] = y; mb->ball_rot[i] = rot;
+        mb->ball_xvel[i] = xvel; mb->ball_yvel[i] = yvel; mb->ball_rvel[i] = rvel;
+    }
+}
+
+#ifndef PONG_FIXED
+#include "matches_simd.h"
+#endif
+
+typedef void (*BatchKernel)(MatchBatch* mb, const signed char* actions, int first, int last);
+
+// the widest kernel this CPU supports
+BatchKernel batch_kernel() {
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(PONG_FIXED)
+    if (__builtin_cpu_supports("avx2")) return batch_step_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return batch_step_sse;
+#endif
+    return batch_step_scalar;
+}
+
+void batch_step_range(MatchBatch* mb, const signed char* actions, int first, int last) {
+    batch_kernel()(mb, actions, first, last);
+}
+
+void batch_step(MatchBatch* mb, const signed char* actions) {
+    batch_step_range(mb, actions, 0, mb->count);
+}
+
+#endif
@@ -0,0 +1,152 @@
+// Body of the branch-free batch kernel in matches_simd.h, instantiated once
+// per instruction set. Include with LANES, KERNEL_NAME and KERNEL_TARGET
+// defined; they are undefined again at the end.
+
+#define LANE_CAT_(a, b) a##b
+#define LANE_CAT(a, b) LANE_CAT_(a, b)
+#define vfloat LANE_CAT(vfloat, LANES)
+#define vmask LANE_CAT(vmask, LANES)
+
+typedef float vfloat __attribute__((vector_size(LANES*sizeof(float))));
+typedef int vmask __attribute__((vector_size(LANES*sizeof(int))));
+
+#define VLOAD(p) ({ vfloat v_; memcpy(&v_, (p), sizeof v_); v_; })
+#define VSTORE(p, v) ({ vfloat v_ = (v); memcpy((p), &v_, sizeof v_); })
+#define VSPLAT(f) ((vfloat){0} + (f)) // never called with -0.0f
+// m ? a : b per lane
+#define VSEL(m, a, b) ((vfloat)(((m) & (vmask)(a)) | (~(m) & (vmask)(b))))
+
+__attribute__((target(KERNEL_TARGET)))
+void KERNEL_NAME(MatchBatch* mb, const signed char* actions, int first, int last) {
+    const float size = mb->ball_size;
+    const float w = mb->paddle_width, h = mb->paddle_height;
+    const float p1x = mb->p1_x, p2x = mb->p2_x;
+    const float damp = 5.0f;
+
+    const vfloat zero = VSPLAT(0.0f);
+    const vfloat up_vel = VSPLAT(0.03f), down_vel = VSPLAT(-0.03f), coast = VSPLAT(0.9f);
+    const vfloat paddle_top = VSPLAT(1.0f-h), paddle_bottom = VSPLAT(-1.0f+h);
+    const vfloat ball_top = VSPLAT(1.0f-size), ball_bottom = VSPLAT(-1.0f+size), inf = VSPLAT(INFINITY);
+    const vfloat vp1x = VSPLAT(p1x), vp2x = VSPLAT(p2x);
+    const vfloat p2_face = VSPLAT(p2x-size-w), p1_face = VSPLAT(p1x+size+w);
+    const vfloat vh = VSPLAT(h), vsize = VSPLAT(size), half_h = VSPLAT(h/2.0f);
+    const vfloat vdamp = VSPLAT(damp), neg = VSPLAT(-1.0f);
+
+    int i = first;
+    for (; i+LANES <= last; i += LANES) {
+        vfloat x = VLOAD(mb->ball_x+i), y = VLOAD(mb->ball_y+i), rot = VLOAD(mb->ball_rot+i);
+        vfloat xvel = VLOAD(mb->ball_xvel+i), yvel = VLOAD(mb->ball_yvel+i), rvel = VLOAD(mb->ball_rvel+i);
+        vfloat p1y = VLOAD(mb->p1_y+i), p1yvel = VLOAD(mb->p1_yvel+i);
+        vfloat p2y = VLOAD(mb->p2_y+i), p2yvel = VLOAD(mb->p2_yvel+i);
+
+        // paddle directions, as batch_track
+        vmask up1, down1, up2, down2;
+        if (actions) {
+            vmask d1 = {0}, d2 = {0};
+            for (int l=0; l<LANES; l++) {
+                d1[l] = actions[2*(i+l)];
+                d2[l] = actions[2*(i+l)+1];
+            }
+            up1 = d1 > 0; down1 = d1 < 0;
+            up2 = d2 > 0; down2 = d2 < 0;
+        } else {
+            vmask right = xvel > zero;
+            vmask track1 = ~(right ^ (vp1x > x));
+            vmask track2 = ~(right ^ (vp2x > x));
+            up1 = track1 & (y > p1y + half_h);
+            down1 = track1 & ~up1 & (y < p1y - half_h);
+            up2 = track2 & (y > p2y + half_h);
+            down2 = track2 & ~up2 & (y < p2y - half_h);
+        }
+
+        // paddles, as batch_paddle
+        p1yvel = VSEL(up1, up_vel, VSEL(down1, down_vel, p1yvel*coast));
+        vmask top1 = p1y+p1yvel > paddle_top;
+        vmask bottom1 = ~top1 & (p1y+p1yvel < paddle_bottom);
+        p1y = VSEL(top1, paddle_top, VSEL(bottom1, paddle_bottom, p1y+p1yvel));
+        p1yvel = VSEL(top1 | bottom1, zero, p1yvel);
+
+        p2yvel = VSEL(up2, up_vel, VSEL(down2, down_vel, p2yvel*coast));
+        vmask top2 = p2y+p2yvel > paddle_top;
+        vmask bottom2 = ~top2 & (p2y+p2yvel < paddle_bottom);
+        p2y = VSEL(top2, paddle_top, VSEL(bottom2, paddle_bottom, p2y+p2yvel));
+        p2yvel = VSEL(top2 | bottom2, zero, p2yvel);
+
+        // ball: swept collisions as in ball_update. a lane drops out of the
+        // loop once it has used up the tick or scored
+        vfloat t_left = VSPLAT(1.0f);
+        vmask active = zero == zero;
+        vmask goal = {0}, goal_right = {0};
+        for (int n=0; n<BALL_MAX_EVENTS; n++) {
+            vmask up = yvel > zero, down = yvel < zero;
+            vfloat t_wall = VSEL(up, (ball_top - y)/yvel, VSEL(down, (ball_bottom - y)/yvel, inf));
+
+            vmask right = xvel > zero;
+            vfloat face = VSEL(right, p2_face, p1_face);
+            vfloat py = VSEL(right, p2y, p1y), pyvel = VSEL(right, p2yvel, p1yvel);
+            vfloat t_face = (face - x)/xvel;
+            vfloat t_goal = (VSEL(right, vp2x, vp1x) - x)/xvel;
+            vfloat hit_y = y + yvel*t_face;
+            vmask hit = (t_face >= zero) & (hit_y < py+vh+vsize) & (hit_y > py-vh-vsize);
+
+            // earliest event this tick
+            vfloat t = t_left;
+            vmask wall = t_wall <= t;
+            t = VSEL(wall, t_wall, t);
+            vmask paddle = hit & (t_face <= t);
+            t = VSEL(paddle, t_face, t);
+            vmask scored = t_goal < t;
+            t = VSEL(scored, t_goal, t);
+            wall &= active & ~paddle & ~scored;
+            paddle &= active & ~scored;
+            scored &= active;
+
+            x = VSEL(active, x + xvel*t, x);
+            y = VSEL(active, y + yvel*t, y);
+            t_left = VSEL(active, t_left - t, t_left);
+
+            goal |= scored;
+            goal_right |= scored & right;
+            y = VSEL(wall, VSEL(up, ball_top, ball_bottom), y);
+            yvel = VSEL(wall, yvel*neg, VSEL(paddle, yvel + pyvel/vdamp, yvel));
+            x = VSEL(paddle, face, x);
+            xvel = VSEL(paddle, xvel*neg, xvel);
+            rvel = VSEL(paddle, VSEL(right, rvel + p2yvel, rvel + -p1yvel), rvel);
+
+            active &= wall | paddle;
+            int any = 0;
+            for (int l=0; l<LANES; l++) any |= active[l];
+            if (!any) break;
+        }
+        rot = VSEL(goal, rot, rot+rvel);
+
+        VSTORE(mb->ball_x+i, x); VSTORE(mb->ball_y+i, y); VSTORE(mb->ball_rot+i, rot);
+        VSTORE(mb->ball_xvel+i, xvel); VSTORE(mb->ball_yvel+i, yvel); VSTORE(mb->ball_rvel+i, rvel);
+        VSTORE(mb->p1_y+i, p1y); VSTORE(mb->p1_yvel+i, p1yvel);
+        VSTORE(mb->p2_y+i, p2y); VSTORE(mb->p2_yvel+i, p2yvel);
+
+        // point to player
+        for (int l=0; l<LANES; l++) {
+            if (!goal[l]) continue;
+            if (goal_right[l]) {
+                mb->p1_score[i+l] += 1;
+            } else {
+                mb->p2_score[i+l] += 1;
+            }
+            batch_serve(mb, i+l);
+        }
+    }
+    batch_step_scalar(mb, actions, i, last);
+}
+
+#undef VSEL
+#undef VSPLAT
+#undef VSTORE
+#undef VLOAD
+#undef vmask
+#undef vfloat
+#undef LANE_CAT
+#undef LANE_CAT_
+#undef KERNEL_TARGET
+#undef KERNEL_NAME
+#undef LANES
@@ -0,0 +1,27 @@
+#ifndef MATCHES_SIMD_H
+#define MATCHES_SIMD_H
+// Branch-free versions of batch_step_scalar that step 8 (AVX2) or 4 (SSE4.1)
+// matches at a time. Every rule in the scalar kernel becomes a lane mask and
+// every branch a blend, and the swept-collision loop runs until no lane has
+// an event left, using GCC vector extensions so the same body in
+// matches_lanes.h is compiled once per instruction set. Only plain IEEE
+// add/sub/mul/div are used, in the same order as the scalar code, so results
+// are bit-identical to it. Serves stay scalar and run after each block, since
+// goals are rare.
+//
+// Requires matches.h.
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LANES 8
+#define KERNEL_NAME batch_step_avx2
+#define KERNEL_TARGET "avx2"
+#include "matches_lanes.h"
+
+#define LANES 4
+#define KERNEL_NAME batch_step_sse
+#define KERNEL_TARGET "sse4.1"
+#include "matches_lanes.h"
+#endif
+
+#endif
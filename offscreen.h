@@ -0,0 +1,352 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+// Offscreen rendering for servers without a display. The GL context comes
+// from EGL on Mesa's surfaceless platform (or the default display when that
+// is missing), so no X server or window is involved. Frames are drawn into
+// an FBO, read back and written as
+//     png  a numbered image per frame; the path is a printf pattern with
+//          exactly one integer conversion, such as frames/%05d.png
+//     y4m  YUV4MPEG2 4:2:0 in full range, which ffmpeg and most encoders
+//          read directly
+//     rgb  raw rgb24 frames, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24
+// y4m and rgb go to a file, or to stdout when the path is "-" so they can be
+// piped straight into an encoder. Frames are produced as fast as the GPU
+// can draw them; the readback ring (readback.h) fetches them asynchronously
+// and they are converted and written on its consumer thread.
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "glstate.h"
+#include "readback.h"
+
+enum OffscreenFormat { OFFSCREEN_PNG, OFFSCREEN_Y4M, OFFSCREEN_RGB };
+
+typedef struct Offscreen {
+    EGLDisplay display;
+    EGLContext context;
+    unsigned int FBO, color;
+    int width, height, fps;
+    enum OffscreenFormat format;
+    const char* path;
+    Readback readback;
+    bool capturing;        // readback started
+    // owned by the readback consumer thread once capturing
+    FILE* out;             // y4m and rgb
+    unsigned char* pixels; // rgb24, top row first
+    unsigned char* planes; // y4m: Y, then U, then V
+    atomic_bool failed;    // a frame could not be written
+} Offscreen;
+
+static void offscreen_consume(void* user, const unsigned char* rgba, int width, int height, long frame);
+
+// format named by s ("png", "y4m" or "rgb"), or guessed from path when s is NULL
+bool offscreen_format(const char* s, const char* path, enum OffscreenFormat* format) {
+    if (s == NULL) {
+        const char* name = strrchr(path, '/');
+        const char* ext = strrchr(name ? name+1 : path, '.');
+        s = ext ? ext+1 : "y4m"; // "-" is a stream
+    }
+    if (strcmp(s, "png") == 0) *format = OFFSCREEN_PNG;
+    else if (strcmp(s, "y4m") == 0) *format = OFFSCREEN_Y4M;
+    else if (strcmp(s, "rgb") == 0 || strcmp(s, "raw") == 0) *format = OFFSCREEN_RGB;
+    else return false;
+    return true;
+}
+
+static bool offscreen_context(Offscreen* os) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    os->display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if (get_platform_display) os->display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+    if (os->display == EGL_NO_DISPLAY) os->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (os->display == EGL_NO_DISPLAY || !eglInitialize(os->display, NULL, NULL)) {
+        fprintf(stderr, "Offscreen: no EGL display\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "Offscreen: EGL has no desktop OpenGL\n");
+        return false;
+    }
+
+    EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE};
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(os->display, config_attribs, &config, 1, &configs) || configs == 0) {
+        fprintf(stderr, "Offscreen: no EGL config for OpenGL\n");
+        return false;
+    }
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+    os->context = eglCreateContext(os->display, config, EGL_NO_CONTEXT, context_attribs);
+    if (os->context == EGL_NO_CONTEXT || !eglMakeCurrent(os->display, EGL_NO_SURFACE, EGL_NO_SURFACE, os->context)) {
+        fprintf(stderr, "Offscreen: failed to create a surfaceless OpenGL 3.3 context\n");
+        return false;
+    }
+
+    glstate_get_proc = (GLADloadproc)eglGetProcAddress;
+    if (!gladLoadGLLoader(glstate_get_proc)) {
+        fprintf(stderr, "Failed to initialize GLAD\n");
+        return false;
+    }
+    return true;
+}
+
+// whether path is a png pattern with exactly one %d conversion (flags and
+// width allowed) and otherwise only %% escapes
+static bool offscreen_pattern(const char* path) {
+    int conversions = 0;
+    for (const char* c = path; *c; c++) {
+        if (*c != '%') continue;
+        c++;
+        if (*c == '%') continue;
+        c += strspn(c, "-+ #0");
+        c += strspn(c, "0123456789");
+        if (*c != 'd' && *c != 'i') return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+// create the context and a width by height render target, and open the output
+bool offscreen_init(Offscreen* os, int width, int height, int fps, enum OffscreenFormat format, const char* path) {
+    *os = (Offscreen){.width = width, .height = height, .fps = fps, .format = format, .path = path};
+    if (format == OFFSCREEN_PNG && !offscreen_pattern(path)) {
+        fprintf(stderr, "Offscreen: png output needs a pattern with one %%d, such as frames/%%05d.png\n");
+        return false;
+    }
+    if (!offscreen_context(os)) return false;
+
+    glGenFramebuffers(1, &os->FBO);
+    glGenRenderbuffers(1, &os->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, os->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, os->FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, os->color);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen: framebuffer incomplete\n");
+        return false;
+    }
+    glViewport(0, 0, width, height);
+
+    os->pixels = malloc((size_t)width*height*3);
+    if (os->pixels == NULL) abort();
+    if (format == OFFSCREEN_Y4M) {
+        os->planes = malloc((size_t)width*height + 2*(size_t)((width+1)/2)*((height+1)/2));
+        if (os->planes == NULL) abort();
+    }
+    if (format != OFFSCREEN_PNG) {
+        if (strcmp(path, "-") == 0) {
+            // the stream gets the real stdout; status messages go to stderr instead
+            fflush(stdout);
+            int fd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+            os->out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        } else {
+            os->out = fopen(path, "wb");
+        }
+        if (os->out == NULL) {
+            perror(path);
+            return false;
+        }
+    }
+    if (format == OFFSCREEN_Y4M) {
+        fprintf(os->out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, fps);
+    }
+    atomic_init(&os->failed, false);
+    readback_init(&os->readback, offscreen_consume, os);
+    os->capturing = true;
+    return true;
+}
+
+static uint32_t png_crc(uint32_t crc, const unsigned char* data, size_t len) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n=0; n<256; n++) {
+            uint32_t c = n;
+            for (int k=0; k<8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i=0; i<len; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void png_u32(unsigned char* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void png_chunk(FILE* f, const char* type, const unsigned char* data, uint32_t len) {
+    unsigned char head[8];
+    png_u32(head, len);
+    memcpy(head+4, type, 4);
+    uint32_t crc = png_crc(png_crc(0, head+4, 4), data, len);
+    unsigned char tail[4];
+    png_u32(tail, crc);
+    fwrite(head, 1, 8, f);
+    fwrite(data, 1, len, f);
+    fwrite(tail, 1, 4, f);
+}
+
+// rgb24 as a PNG whose zlib stream uses stored blocks: no compression, but no
+// dependency and almost no CPU, which is what matters when an encoder follows
+bool png_write(const char* path, const unsigned char* rgb, int width, int height) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) return false;
+    size_t row = (size_t)width*3 + 1; // filter byte, then pixels
+    size_t raw = row*height;
+    size_t blocks = (raw + 65534)/65535;
+    size_t len = 2 + raw + blocks*5 + 4;
+    unsigned char* idat = malloc(len);
+    if (idat == NULL) abort();
+
+    unsigned char* p = idat;
+    *p++ = 0x78; *p++ = 0x01; // zlib header, no compression
+    uint32_t a = 1, b = 0; // adler32
+    size_t left = raw, pos = 0;
+    while (left > 0) {
+        uint16_t n = left > 65535 ? 65535 : left;
+        *p++ = left == n; // final block flag, type 00
+        p[0] = n; p[1] = n >> 8; p[2] = ~n; p[3] = ~n >> 8;
+        p += 4;
+        for (uint16_t i=0; i<n; i++, pos++) {
+            size_t x = pos % row;
+            unsigned char c = x == 0 ? 0 : rgb[(pos/row)*(row-1) + x-1];
+            *p++ = c;
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        left -= n;
+    }
+    png_u32(p, b << 16 | a);
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    unsigned char ihdr[13];
+    png_u32(ihdr, width);
+    png_u32(ihdr+4, height);
+    ihdr[8] = 8;  // bits per channel
+    ihdr[9] = 2;  // rgb
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    fwrite(signature, 1, 8, f);
+    png_chunk(f, "IHDR", ihdr, 13);
+    png_chunk(f, "IDAT", idat, len);
+    png_chunk(f, "IEND", NULL, 0);
+    free(idat);
+    return fclose(f) == 0;
+}
+
+// full-range BT.601, chroma averaged over each 2x2 block
+static void offscreen_yuv420(Offscreen* os) {
+    int w = os->width, h = os->height, cw = (w+1)/2, ch = (h+1)/2;
+    unsigned char* Y = os->planes;
+    unsigned char* U = Y + (size_t)w*h;
+    unsigned char* V = U + (size_t)cw*ch;
+    for (int y=0; y<h; y++) {
+        const unsigned char* src = os->pixels + (size_t)y*w*3;
+        for (int x=0; x<w; x++) {
+            int r = src[x*3], g = src[x*3+1], b = src[x*3+2];
+            Y[(size_t)y*w + x] = (77*r + 150*g + 29*b + 128) >> 8;
+        }
+    }
+    for (int cy=0; cy<ch; cy++) {
+        for (int cx=0; cx<cw; cx++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy=0; dy<2 && cy*2+dy<h; dy++) {
+                for (int dx=0; dx<2 && cx*2+dx<w; dx++) {
+                    const unsigned char* s = os->pixels + ((size_t)(cy*2+dy)*w + cx*2+dx)*3;
+                    r += s[0]; g += s[1]; b += s[2]; n++;
+                }
+            }
+            r /= n; g /= n; b /= n;
+            U[(size_t)cy*cw + cx] = (-43*r - 85*g + 128*b + 32768) >> 8;
+            V[(size_t)cy*cw + cx] = (128*r - 107*g - 21*b + 32768) >> 8;
+        }
+    }
+}
+
+// rgba rows from GL, bottom first, as rgb24 rows top first
+void image_rgb_flipped(const unsigned char* rgba, int width, int height, unsigned char* rgb) {
+    for (int y=0; y<height; y++) {
+        const unsigned char* src = rgba + (size_t)(height-1-y)*width*4;
+        unsigned char* dst = rgb + (size_t)y*width*3;
+        for (int x=0; x<width; x++) {
+            dst[x*3] = src[x*4];
+            dst[x*3+1] = src[x*4+1];
+            dst[x*3+2] = src[x*4+2];
+        }
+    }
+}
+
+// readback consumer: convert and write one frame
+static void offscreen_consume(void* user, const unsigned char* rgba, int width, int height, long frame) {
+    Offscreen* os = user;
+    if (atomic_load(&os->failed)) return;
+    image_rgb_flipped(rgba, width, height, os->pixels);
+
+    bool ok;
+    if (os->format == OFFSCREEN_PNG) {
+        char path[4096];
+        snprintf(path, sizeof(path), os->path, (int)frame); // checked by offscreen_pattern
+        ok = png_write(path, os->pixels, width, height);
+        if (!ok) perror(path);
+    } else if (os->format == OFFSCREEN_Y4M) {
+        offscreen_yuv420(os);
+        size_t size = (size_t)width*height + 2*(size_t)((width+1)/2)*((height+1)/2);
+        ok = fputs("FRAME\n", os->out) >= 0 && fwrite(os->planes, 1, size, os->out) == size;
+    } else {
+        size_t size = (size_t)width*height*3;
+        ok = fwrite(os->pixels, 1, size, os->out) == size;
+    }
+    if (!ok) atomic_store(&os->failed, true);
+}
+
+// queue what has been drawn into the render target as the next frame.
+// false once an earlier frame failed to write
+bool offscreen_write(Offscreen* os) {
+    readback_capture(&os->readback, os->FBO, os->width, os->height);
+    return !atomic_load(&os->failed);
+}
+
+// wait until every queued frame is written
+bool offscreen_finish(Offscreen* os) {
+    readback_finish(&os->readback);
+    if (os->out != NULL) fflush(os->out);
+    return !atomic_load(&os->failed);
+}
+
+double offscreen_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+void offscreen_cleanup(Offscreen* os) {
+    if (os->capturing) readback_cleanup(&os->readback);
+    if (os->out != NULL) fclose(os->out);
+    free(os->pixels);
+    free(os->planes);
+    if (os->context != EGL_NO_CONTEXT && os->context != NULL) {
+        glDeleteFramebuffers(1, &os->FBO);
+        glDeleteRenderbuffers(1, &os->color);
+        eglMakeCurrent(os->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(os->display, os->context);
+    }
+    if (os->display != EGL_NO_DISPLAY && os->display != NULL) eglTerminate(os->display);
+}
+
+#endif
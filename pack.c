@@ -0,0 +1,137 @@
+// Asset packer: writes every file under the given directories into one
+// archive for archive.h. Run by `make resources.pak`.
+//     ./pack resources.pak resources
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+typedef struct PackFile {
+    char* path;
+    ArchiveEntry entry;
+} PackFile;
+
+PackFile* files;
+int file_count, file_capacity;
+
+void add_file(const char* path) {
+    if (file_count == file_capacity) {
+        file_capacity = file_capacity ? file_capacity*2 : 64;
+        files = realloc(files, file_capacity*sizeof(PackFile));
+        if (files == NULL) abort();
+    }
+    files[file_count++] = (PackFile){.path = strdup(archive_path(path))};
+}
+
+// every regular file below path, skipping hidden ones
+void walk(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "pack: %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    if (S_ISREG(st.st_mode)) {
+        add_file(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "pack: %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        char child[strlen(path)+strlen(ent->d_name)+2];
+        snprintf(child, sizeof(child), "%s%s%s", path, path[strlen(path)-1] == '/' ? "" : "/", ent->d_name);
+        walk(child);
+    }
+    closedir(dir);
+}
+
+int compare_paths(const void* a, const void* b) {
+    return strcmp(((const PackFile*)a)->path, ((const PackFile*)b)->path);
+}
+
+int compare_hashes(const void* a, const void* b) {
+    uint64_t x = ((const PackFile*)a)->entry.hash, y = ((const PackFile*)b)->entry.hash;
+    return (x > y) - (x < y);
+}
+
+void pad(FILE* out, long to) {
+    while (ftell(out) < to) fputc(0, out);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s archive dir...\n", argv[0]);
+        return 1;
+    }
+    for (int i=2; i<argc; i++) walk(argv[i]);
+    // the same tree always packs to the same bytes
+    qsort(files, file_count, sizeof(PackFile), compare_paths);
+
+    uint32_t names_size = 0;
+    for (int i=0; i<file_count; i++) {
+        files[i].entry.hash = archive_hash(files[i].path);
+        files[i].entry.name = names_size;
+        names_size += strlen(files[i].path)+1;
+    }
+
+    char tmp[strlen(argv[1])+5];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", argv[1]);
+    FILE* out = fopen(tmp, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "pack: %s: %s\n", tmp, strerror(errno));
+        return 1;
+    }
+
+    // contents first, after room for the tables, so their offsets are known
+    ArchiveHeader header = {ARCHIVE_MAGIC, ARCHIVE_VERSION, file_count, names_size};
+    long data_start = sizeof(header) + file_count*sizeof(ArchiveEntry) + names_size;
+    fseek(out, 0, SEEK_SET);
+    pad(out, data_start);
+    size_t total = 0;
+    for (int i=0; i<file_count; i++) {
+        size_t size;
+        char* data = readFile(files[i].path, &size);
+        if (data == NULL) {
+            fprintf(stderr, "pack: cannot read %s\n", files[i].path);
+            return 1;
+        }
+        pad(out, (ftell(out) + ARCHIVE_ALIGN-1) & ~(long)(ARCHIVE_ALIGN-1));
+        files[i].entry.offset = ftell(out);
+        files[i].entry.size = size;
+        fwrite(data, 1, size+1, out); // with its NUL
+        total += size;
+        free(data);
+    }
+
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+    PackFile by_path[file_count];
+    memcpy(by_path, files, file_count*sizeof(PackFile));
+    qsort(files, file_count, sizeof(PackFile), compare_hashes);
+    for (int i=0; i<file_count; i++) {
+        if (i > 0 && files[i].entry.hash == files[i-1].entry.hash) {
+            fprintf(stderr, "pack: %s and %s have the same hash\n", files[i-1].path, files[i].path);
+            return 1;
+        }
+        fwrite(&files[i].entry, sizeof(ArchiveEntry), 1, out);
+    }
+    for (int i=0; i<file_count; i++) fwrite(by_path[i].path, 1, strlen(by_path[i].path)+1, out);
+
+    if (fclose(out) != 0 || rename(tmp, argv[1]) != 0) {
+        fprintf(stderr, "pack: cannot write %s: %s\n", argv[1], strerror(errno));
+        remove(tmp);
+        return 1;
+    }
+    printf("Packed %d files, %zu bytes, into %s\n", file_count, total, argv[1]);
+    return 0;
+}
@@ -1,8 +1,12 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <cglm/cglm.h>
 #include <cglm/call.h>
@@ -16,27 +20,179 @@
 #include "gameobjects.h"
 
 #include "render.h"
+#include "rectbatch.h"
+#include "camera.h"
+#include "text.h"
+#include "hotreload.h"
+#include "swraster.h"
+#include "offscreen.h"
+#include "gputimer.h"
+#include "triplebuffer.h"
 #include "color.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+typedef struct SimSnapshot SimSnapshot;
 void update();
+void level_load();
+void level_unload();
+void render_batched(const SimSnapshot* sim, float alpha);
+void scene_objects(Object* objects, const SimSnapshot* sim, float alpha);
+void hud_update(const SimSnapshot* sim);
+bool scene_init();
+void render_frame(const SimSnapshot* sim, float alpha);
+void scene_cleanup();
+void set_software(bool on);
+void screenshot_save(void* user, const unsigned char* rgba, int width, int height, long frame);
+void sim_snapshot(SimSnapshot* sim, double time);
+void sim_start();
+void sim_stop();
+int run_offscreen(int frames, int width, int height, enum OffscreenFormat format, const char* path);
 
 // settings
 unsigned int SCR_WIDTH = 1280;
 unsigned int SCR_HEIGHT = 720;
 
+// simulation runs at a fixed rate independent of the display refresh rate.
+// all velocities in gameobjects.h are expressed per tick and tuned for 60 Hz
+#define TICK_RATE 60.0
+#define TICK_TIME (1.0/TICK_RATE)
+#define MAX_CATCHUP_TICKS 8 // drop simulation time instead of spiralling when a tick stalls
+
 int FILLMODE = GL_FILL;
 int prevkey = GLFW_RELEASE;
+bool BATCHED = true; // F3 switches to one draw call per object for comparison
+int prevbatchkey = GLFW_RELEASE;
+bool DEBUG_OVERLAY = false; // F4 shows per-frame GL call and stream stats and pass timings
+int prevoverlaykey = GLFW_RELEASE;
+bool SOFTWARE = false; // F5 rasterizes on the CPU, see swraster.h and set_software; PONG_RENDERER=software starts with it
+int prevsoftwarekey = GLFW_RELEASE;
+bool screenshot_requested = false; // F12 saves the next frame as a png
+int prevscreenshotkey = GLFW_RELEASE;
+
+// paddle direction from the last input poll, applied once per tick
+atomic_int player1_dir = 0;
+atomic_int player2_dir = 0;
+
+// court dimensions, shared by the level meshes and the batch renderer
+#define COURT_HALF_WIDTH 1.2f
+#define COURT_HALF_HEIGHT 1.0f
+#define COURT_BORDER 0.01f
+#define CENTER_LINE_LENGTH 2.0f
+#define CENTER_LINE_HALF_WIDTH 0.005f
+#define CENTER_LINE_DASHES 20
+#define CENTER_LINE_SPACING 0.01f
+
+// everything a level creates comes from these pools and the mesh registry, carved out of one arena
+#define LEVEL_MAX_OBJECTS 16
+#define LEVEL_MAX_MESHES 16
+#define LEVEL_MESH_BYTES 16384 // CPU copies of the meshes' vertex and index data
+Arena level_arena;
+Pool player_pool, ball_pool, object_pool;
+MeshRegistry meshes;
 
 Player* player1;
 Player* player2;
 Ball* ball;
 Object* game_border;
+Object* center_line;
+VertexObject* quad_mesh;
+
+// paddles and ball as drawn: the shared unit quad scaled to their size
+#define PADDLE(p) OBJECT(quad_mesh, p, real_to_float((p)->width), real_to_float((p)->height))
+#define BALL(b) OBJECT(quad_mesh, b, real_to_float((b)->size), real_to_float((b)->size))
+
+// state at the start of the current tick, used to interpolate between ticks when rendering
+Object player1_prev, player2_prev, ball_prev;
+
+// in a window the simulation ticks on its own thread and publishes what the
+// renderer needs once per tick; the render thread draws the latest without
+// either one waiting for the other, see triplebuffer.h
+#define SIM_OBJECTS 3 // paddles, then the ball
+struct SimSnapshot {
+    Object prev[SIM_OBJECTS], curr[SIM_OBJECTS]; // at the tick before and the latest one
+    Scoreboard scoreboard;
+    double time; // when the latest tick was due
+};
+TripleBuffer sim_snapshots;
+pthread_t sim_thread;
+atomic_bool sim_running;
+
+// per-frame data for the GPU, see stream.h
+#define FRAME_STREAM_SIZE (64*1024)
+StreamBuffer frame_stream;
+
+// resources packed by `make resources.pak`, see archive.h. without it
+// they are read from disk
+#define ASSET_ARCHIVE "./resources.pak"
+Archive assets;
+
+// every program in the shader directory, looked up by name
+#define SHADER_DIR "./resources/shaders/"
+ShaderLibrary shaders;
+ShaderProgram *color_shader, *rect_shader, *text_shader, *present_shader;
+
+RectBatch rect_batch;
+Camera camera;
+SwRaster sw_raster;
+GpuTimer gpu_timer; // per-pass GPU and CPU time, see gputimer.h
+#define SCENE_OBJECTS 5
+
+// scores, match clock and debug stats, all drawn in one call
+#define FONT_PATH "./resources/fonts/DejaVuSansMono-Bold.ttf"
+#define FONT_PIXEL_SIZE 48
+TextRenderer text_renderer;
+bool hud_enabled;
+Scoreboard scoreboard;
+TextMesh score_text, clock_text, debug_text, timing_text;
 
-int main() {
-    // seed random numbers
-    srand(time(0));
+// shader edits show up without a restart
+HotReload hot_reload = {.on_swap = camera_attach};
+bool hot_reload_running;
+
+// F12 screenshots, read back without stalling the frame, see readback.h
+Readback screenshots;
+
+uint64_t ball_seed;
+
+// usage: pong [-o output [-f png|y4m|rgb] [-n frames] [-r WxH]] [-s seed]
+//
+// -o renders a computer-vs-computer match offscreen instead of opening a
+//    window, see offscreen.h. "-" streams to stdout
+int main(int argc, char** argv) {
+    const char* output = NULL;
+    const char* format_name = NULL;
+    int frames = 600;
+    int width = SCR_WIDTH, height = SCR_HEIGHT;
+    ball_seed = time(0);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:f:n:r:s:")) != -1) {
+        switch (opt) {
+            case 'o': output = optarg; break;
+            case 'f': format_name = optarg; break;
+            case 'n': frames = atoi(optarg); break;
+            case 'r':
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2) width = height = 0;
+                break;
+            case 's': ball_seed = strtoull(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-o output [-f png|y4m|rgb] [-n frames] [-r WxH]] [-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (output != NULL) {
+        enum OffscreenFormat format;
+        if (!offscreen_format(format_name, output, &format)) {
+            fprintf(stderr, "unknown output format, use png, y4m or rgb\n");
+            return 1;
+        }
+        if (frames <= 0 || width <= 0 || height <= 0) {
+            fprintf(stderr, "frames and size must be positive\n");
+            return 1;
+        }
+        return run_offscreen(frames, width, height, format, output);
+    }
 
     // glfw: initialize and configure
     glfwInit();
@@ -52,50 +208,332 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(1); // render rate follows vsync, simulation rate follows TICK_RATE
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // glad: load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    glstate_get_proc = (GLADloadproc)glfwGetProcAddress;
+    if (!gladLoadGLLoader(glstate_get_proc)) {
         printf("Failed to initialize GLAD");
         return -1;
     }
 
-    unsigned int shader_program = loadShaders("./resources/shaders/");
-    Object game_border = {colorRectOutline(1.2f, 1.0f, 0.01f, WHITE), 0.0f, 0.0f};
-    Object center_line = {colorDashedLine(2.0f, 0.005f, 20, 0.01f, WHITE), 0.0f, 0.0f};
-    player1 = mkPlayer(-0.95f, 0.0f, 0.02f, 0.25f, WHITE);
-    player2 = mkPlayer(0.95f, 0.0f, 0.02f, 0.25f, WHITE);
-    ball = mkBall(0.0f, 0.0f, copysignf(0.01f,sinf(rand())), sinf(rand())/100.0f, 0.02f, WHITE);
+    if (!scene_init()) {
+        glfwTerminate();
+        return -1;
+    }
+    hot_reload_running = hotreload_start(&hot_reload, &shaders, window);
+    readback_init(&screenshots, screenshot_save, NULL);
+    sim_start();
 
     // render loop
     while (!glfwWindowShouldClose(window)) {
         processInput(window);
-        render_begin();
-        render((Object*)player1, FILLMODE, shader_program);
-        render((Object*)player2, FILLMODE, shader_program);
-        render((Object*)ball, FILLMODE, shader_program);
-        render(&game_border, FILLMODE, shader_program);
-        render(&center_line, FILLMODE, shader_program);
-        update();
+
+        // the latest tick blended with the one before, by how far the clock is past it
+        triple_acquire(&sim_snapshots);
+        const SimSnapshot* sim = triple_front(&sim_snapshots);
+        float alpha = (float)((glfwGetTime() - sim->time)/TICK_TIME);
+        if (alpha < 0.0f) alpha = 0.0f;
+        if (alpha > 1.0f) alpha = 1.0f; // the simulation is behind
+
+        if (hot_reload_running) hotreload_swap(&hot_reload);
+        render_frame(sim, alpha);
+
+        if (screenshot_requested) readback_capture(&screenshots, 0, SCR_WIDTH, SCR_HEIGHT);
+        else readback_poll(&screenshots);
+        screenshot_requested = false;
 
         glfwSwapBuffers(window);
         glfwPollEvents(); // poll inputs mouse/keyboard
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
-    render_cleanup(player1->vertobj);
-    render_cleanup(player2->vertobj);
-    glDeleteProgram(shader_program);
+    sim_stop();
+    if (hot_reload_running) hotreload_stop(&hot_reload);
+    readback_cleanup(&screenshots);
+    gpu_timer_report(&gpu_timer, stdout);
+    scene_cleanup();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     glfwTerminate();
     return 0;
 }
 
+// render a match to images or video, one frame per tick, with both paddles
+// following the ball
+int run_offscreen(int frames, int width, int height, enum OffscreenFormat format, const char* path) {
+    Offscreen os;
+    if (!offscreen_init(&os, width, height, (int)TICK_RATE, format, path)) {
+        offscreen_cleanup(&os);
+        return -1;
+    }
+    SCR_WIDTH = width;
+    SCR_HEIGHT = height;
+    if (!scene_init()) {
+        offscreen_cleanup(&os);
+        return -1;
+    }
+
+    double start = offscreen_clock();
+    bool ok = true;
+    for (int i=0; i<frames && ok; i++) {
+        player1_dir = player_track(player1, ball);
+        player2_dir = player_track(player2, ball);
+        update();
+        SimSnapshot sim;
+        sim_snapshot(&sim, 0.0);
+        render_frame(&sim, 1.0f);
+        ok = offscreen_write(&os);
+    }
+    ok = offscreen_finish(&os) && ok;
+    double elapsed = offscreen_clock() - start;
+    Readback* rb = &os.readback;
+    fprintf(stderr, "Rendered %ld frames in %.2f s, %.1f fps\n", rb->frames, elapsed, rb->frames/elapsed);
+    fprintf(stderr, "Capture: %.3f ms per frame on the render thread, %.3f ms at most, %u stalls\n",
+            rb->cpu_ms/rb->frames, rb->max_ms, rb->stalls);
+    gpu_timer_report(&gpu_timer, stderr);
+
+    scene_cleanup();
+    offscreen_cleanup(&os);
+    return ok ? 0 : 1;
+}
+
+// everything the renderer needs, on the current context
+bool scene_init() {
+    if (!archive_open(&assets, ASSET_ARCHIVE)) printf("No asset archive, reading resources from disk\n");
+    programCacheInit();
+    shader_library_load(&shaders, &assets, SHADER_DIR);
+    shader_library_report(&shaders, stdout);
+    color_shader = shader_find(&shaders, "color");
+    rect_shader = shader_find(&shaders, "rect");
+    text_shader = shader_find(&shaders, "text");
+    present_shader = shader_find(&shaders, "present");
+    if (color_shader == NULL || rect_shader == NULL || text_shader == NULL || present_shader == NULL) {
+        printf("Missing shaders in \"%s\"\n", SHADER_DIR);
+        return false;
+    }
+    stream_init(&frame_stream, FRAME_STREAM_SIZE);
+    camera_init(&camera, SCR_WIDTH, SCR_HEIGHT);
+    for (int i=0; i<shaders.count; i++) camera_attach(shaders.programs[i].program);
+
+    hud_enabled = text_renderer_init(&text_renderer, &frame_stream, &assets, FONT_PATH, FONT_PIXEL_SIZE);
+    text_init(&score_text, 0.0f, 0.8f, 0.2f, TEXT_CENTER, WHITE);
+    text_init(&clock_text, 0.0f, 0.7f, 0.07f, TEXT_CENTER, WHITE);
+    text_init(&debug_text, -COURT_HALF_WIDTH+0.05f, -COURT_HALF_HEIGHT+0.05f, 0.04f, TEXT_LEFT, GREEN);
+    text_init(&timing_text, -COURT_HALF_WIDTH+0.05f, -COURT_HALF_HEIGHT+0.11f, 0.04f, TEXT_LEFT, GREEN);
+    gpu_timer_init(&gpu_timer);
+
+    const char* renderer = getenv("PONG_RENDERER");
+    set_software(renderer != NULL && strcmp(renderer, "software") == 0);
+    arena_init(&level_arena, pool_size(sizeof(Player), 2) + pool_size(sizeof(Ball), 1) +
+                             pool_size(sizeof(Object), LEVEL_MAX_OBJECTS) +
+                             mesh_registry_size(LEVEL_MAX_MESHES, LEVEL_MESH_BYTES));
+    level_load();
+    return true;
+}
+
+// draw one frame into the current framebuffer
+void render_frame(const SimSnapshot* sim, float alpha) {
+    TextMesh* hud[] = {&score_text, &clock_text, &debug_text, &timing_text};
+    int hud_count = DEBUG_OVERLAY ? 4 : 2;
+    if (hud_enabled) hud_update(sim);
+    gpu_timer_begin(&gpu_timer, "clear");
+    render_begin();
+    gpu_timer_begin(&gpu_timer, "objects");
+    if (BATCHED && render_backend == NULL) {
+        render_batched(sim, alpha);
+    } else {
+        Object objects[SCENE_OBJECTS];
+        scene_objects(objects, sim, alpha);
+        render_objects(objects, SCENE_OBJECTS, FILLMODE, color_shader->program);
+    }
+    if (hud_enabled) {
+        gpu_timer_begin(&gpu_timer, "hud");
+        text_draw(&text_renderer, hud, hud_count, text_shader->program);
+    }
+    if (render_backend != NULL) gpu_timer_begin(&gpu_timer, "present");
+    render_end();
+    gpu_timer_end_frame(&gpu_timer);
+
+    stream_end_frame(&frame_stream);
+    glstate_end_frame();
+}
+
+void scene_cleanup() {
+    gpu_timer_cleanup(&gpu_timer);
+    set_software(false);
+    level_unload();
+    arena_free(&level_arena);
+    stream_cleanup(&frame_stream);
+    camera_cleanup(&camera);
+    if (hud_enabled) text_renderer_cleanup(&text_renderer);
+    text_free(&score_text);
+    text_free(&clock_text);
+    text_free(&debug_text);
+    text_free(&timing_text);
+    shader_library_free(&shaders);
+    archive_close(&assets);
+}
+
+// start or stop the CPU rasterizer, whose threads only exist while it draws
+void set_software(bool on) {
+    if (on == SOFTWARE) return;
+    SOFTWARE = on;
+    if (on) {
+        sw_init(&sw_raster, SCR_WIDTH, SCR_HEIGHT, 0);
+        render_backend = sw_backend(&sw_raster, &meshes, camera.view_projection, present_shader);
+    } else {
+        render_backend = NULL;
+        sw_cleanup(&sw_raster);
+    }
+}
+
+// create the court, paddles and ball
+void level_load() {
+    pool_init(&player_pool, &level_arena, sizeof(Player), 2);
+    pool_init(&ball_pool, &level_arena, sizeof(Ball), 1);
+    pool_init(&object_pool, &level_arena, sizeof(Object), LEVEL_MAX_OBJECTS);
+    mesh_registry_init(&meshes, &level_arena, LEVEL_MAX_MESHES);
+
+    game_border = mkObject(&object_pool, colorRectOutline(&meshes, COURT_HALF_WIDTH, COURT_HALF_HEIGHT, COURT_BORDER, WHITE), 0.0f, 0.0f);
+    center_line = mkObject(&object_pool, colorDashedLine(&meshes, CENTER_LINE_LENGTH, CENTER_LINE_HALF_WIDTH, CENTER_LINE_DASHES, CENTER_LINE_SPACING, WHITE), 0.0f, 0.0f);
+    player1 = mkPlayer(&player_pool, -0.95f, 0.0f, 0.02f, 0.25f);
+    player2 = mkPlayer(&player_pool, 0.95f, 0.0f, 0.02f, 0.25f);
+    ball = mkBall(&ball_pool, 0.0f, 0.0f, 0.02f, rng_key(ball_seed, 0));
+    quad_mesh = unitQuad(&meshes);
+    rectbatch_init(&rect_batch, quad_mesh, &frame_stream, LEVEL_MAX_OBJECTS);
+    mesh_report(&meshes, stdout);
+
+    player1_prev = PADDLE(player1);
+    player2_prev = PADDLE(player2);
+    ball_prev = BALL(ball);
+
+    scoreboard = (Scoreboard){0};
+}
+
+// free the GL buffers of every mesh in the level, then everything else at once
+void level_unload() {
+    rectbatch_cleanup(&rect_batch);
+    mesh_registry_release(&meshes);
+    arena_reset(&level_arena);
+}
+
+// the level as objects to draw one by one, moving ones between the last two ticks
+void scene_objects(Object* objects, const SimSnapshot* sim, float alpha) {
+    for (int i=0; i<SIM_OBJECTS; i++) objects[i] = lerp_object(&sim->prev[i], &sim->curr[i], alpha);
+    objects[3] = *game_border;
+    objects[4] = *center_line;
+}
+
+// draw every rectangle in the level with a single instanced draw call
+void render_batched(const SimSnapshot* sim, float alpha) {
+    rectbatch_begin(&rect_batch);
+    for (int i=0; i<SIM_OBJECTS; i++) {
+        Object o = lerp_object(&sim->prev[i], &sim->curr[i], alpha);
+        rectbatch_add(&rect_batch, o.xpos, o.ypos, o.xscale, o.yscale, o.rot, o.color);
+    }
+    rectbatch_outline(&rect_batch, 0.0f, 0.0f, COURT_HALF_WIDTH, COURT_HALF_HEIGHT, COURT_BORDER, WHITE);
+    rectbatch_dashed_line(&rect_batch, 0.0f, 0.0f, CENTER_LINE_LENGTH, CENTER_LINE_HALF_WIDTH,
+                          CENTER_LINE_DASHES, CENTER_LINE_SPACING, WHITE);
+    rectbatch_draw(&rect_batch, FILLMODE, rect_shader->program);
+}
+
+// refresh the HUD strings; text meshes only rebuild when their string changes
+void hud_update(const SimSnapshot* sim) {
+    char text[160];
+    snprintf(text, sizeof(text), "%d   %d", sim->scoreboard.player1, sim->scoreboard.player2);
+    text_set(&score_text, &text_renderer.atlas, text);
+
+    unsigned long seconds = sim->scoreboard.time/(unsigned long)TICK_RATE;
+    snprintf(text, sizeof(text), "%lu:%02lu", seconds/60, seconds%60);
+    text_set(&clock_text, &text_renderer.atlas, text);
+
+    if (DEBUG_OVERLAY) {
+        // GL calls of the last frame that went to the driver and that the state cache dropped
+        GLStats stats = glstate.last_frame;
+        if (SOFTWARE) {
+            snprintf(text, sizeof(text), "software | %d threads, %d tiles | raster: %.2f ms",
+                     sw_raster.thread_count+1, sw_raster.tiles_x*sw_raster.tiles_y, sw_raster.raster_ms);
+        } else {
+            snprintf(text, sizeof(text), "%s | GL calls: %u issued, %u skipped | stream: %s, %u stalls",
+                     BATCHED ? "batched" : "per object", stats.issued, stats.skipped,
+                     frame_stream.persistent ? "persistent" : "orphaning", frame_stream.stalls);
+        }
+        text_set(&debug_text, &text_renderer.atlas, text);
+        gpu_timer_format(&gpu_timer, text, sizeof(text));
+        text_set(&timing_text, &text_renderer.atlas, text);
+    }
+}
+
+// advance the simulation by one fixed tick
 void update() {
-    player_update(player1);
-    player_update(player2);
-    ball_update(ball, player1, player2);
+    player1_prev = PADDLE(player1);
+    player2_prev = PADDLE(player2);
+    ball_prev = BALL(ball);
+
+    int score = player1->score + player2->score;
+    match_update(player1, player2, ball, player1_dir, player2_dir);
+    scoreboard_update(&scoreboard, player1, player2);
+    scoreboard.time++;
+    // don't interpolate the ball across a serve
+    if (player1->score + player2->score != score)
+        ball_prev = BALL(ball);
+}
+
+// what the renderer needs of the simulation after its latest tick, due at time
+void sim_snapshot(SimSnapshot* sim, double time) {
+    sim->prev[0] = player1_prev;
+    sim->prev[1] = player2_prev;
+    sim->prev[2] = ball_prev;
+    sim->curr[0] = PADDLE(player1);
+    sim->curr[1] = PADDLE(player2);
+    sim->curr[2] = BALL(ball);
+    sim->scoreboard = scoreboard;
+    sim->time = time;
+}
+
+// tick at TICK_RATE on the simulation's own clock, whatever the renderer is doing
+static void* sim_worker(void* arg) {
+    double next = glfwGetTime() + TICK_TIME;
+    while (atomic_load(&sim_running)) {
+        double now = glfwGetTime();
+        if (now - next > MAX_CATCHUP_TICKS*TICK_TIME) next = now;
+        if (now >= next) {
+            while (now >= next) {
+                update();
+                next += TICK_TIME;
+            }
+            sim_snapshot(triple_back(&sim_snapshots), next - TICK_TIME);
+            triple_publish(&sim_snapshots);
+        }
+
+        double wait = next - glfwGetTime();
+        if (wait > 0.0) {
+            struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait)*1e9)};
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+// hand the simulation to its own thread; the level must be loaded. until
+// sim_stop the render thread only sees it through sim_snapshots
+void sim_start() {
+    triple_init(&sim_snapshots, sizeof(SimSnapshot));
+    sim_snapshot(triple_back(&sim_snapshots), glfwGetTime());
+    triple_publish(&sim_snapshots);
+    atomic_init(&sim_running, true);
+    if (pthread_create(&sim_thread, NULL, sim_worker, NULL) != 0) {
+        fprintf(stderr, "Failed to start the simulation thread\n");
+        abort();
+    }
+}
+
+void sim_stop() {
+    atomic_store(&sim_running, false);
+    pthread_join(sim_thread, NULL);
+    triple_cleanup(&sim_snapshots);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -105,28 +543,63 @@ void processInput(GLFWwindow *window) {
     
     // Player 1
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        player1->yvel = 0.03f;
+        player1_dir = 1;
     } else 
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        player1->yvel = -0.03f;
+        player1_dir = -1;
     } else {
-        player1->yvel *= 0.9f;
+        player1_dir = 0;
     }
 
     // Player 2
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-        player2->yvel = 0.03f;
+        player2_dir = 1;
     } else 
     if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-        player2->yvel = -0.03f;
+        player2_dir = -1;
     } else {
-        player2->yvel *= 0.9f;
+        player2_dir = 0;
     }
 
     int debugkey = glfwGetKey(window, GLFW_KEY_F2);
     if (debugkey == GLFW_PRESS && prevkey == GLFW_RELEASE)
         FILLMODE ^= (GL_LINE ^ GL_FILL);
     prevkey = debugkey;
+
+    int batchkey = glfwGetKey(window, GLFW_KEY_F3);
+    if (batchkey == GLFW_PRESS && prevbatchkey == GLFW_RELEASE)
+        BATCHED = !BATCHED;
+    prevbatchkey = batchkey;
+
+    int overlaykey = glfwGetKey(window, GLFW_KEY_F4);
+    if (overlaykey == GLFW_PRESS && prevoverlaykey == GLFW_RELEASE)
+        DEBUG_OVERLAY = !DEBUG_OVERLAY;
+    prevoverlaykey = overlaykey;
+
+    int softwarekey = glfwGetKey(window, GLFW_KEY_F5);
+    if (softwarekey == GLFW_PRESS && prevsoftwarekey == GLFW_RELEASE)
+        set_software(!SOFTWARE);
+    prevsoftwarekey = softwarekey;
+
+    int screenshotkey = glfwGetKey(window, GLFW_KEY_F12);
+    if (screenshotkey == GLFW_PRESS && prevscreenshotkey == GLFW_RELEASE)
+        screenshot_requested = true;
+    prevscreenshotkey = screenshotkey;
+}
+
+// runs on the screenshot readback thread
+void screenshot_save(void* user, const unsigned char* rgba, int width, int height, long frame) {
+    unsigned char* rgb = malloc((size_t)width*height*3);
+    if (rgb == NULL) abort();
+    image_rgb_flipped(rgba, width, height, rgb);
+
+    char path[64];
+    time_t now = time(0);
+    size_t n = strftime(path, sizeof(path), "screenshot-%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(path+n, sizeof(path)-n, "-%ld.png", frame);
+    if (png_write(path, rgb, width, height)) printf("Saved %s\n", path);
+    else perror(path);
+    free(rgb);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -137,4 +610,6 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     SCR_WIDTH = width;
     SCR_HEIGHT = height;
     glViewport(0,0,width,height);
+    camera_resize(&camera, width, height);
+    if (SOFTWARE) sw_resize(&sw_raster, width, height);
 }
@@ -0,0 +1,130 @@
+// libpongsim.so: the C API in pongsim.h on top of the batch simulator.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "matches.h"
+
+#define PONGSIM_API __attribute__((visibility("default")))
+#include "pongsim.h"
+
+struct PongSim {
+    MatchBatch mb;
+    BatchKernel kernel; // picked once for this CPU
+    int score_limit;
+
+    // scores after the previous step, for rewards
+    int* prev_p1_score;
+    int* prev_p2_score;
+
+    bool needs_reset; // set by bind, cleared by reset_batch
+
+    // caller-owned
+    float* obs;
+    float* reward;
+    unsigned char* done;
+};
+
+static void pongsim_observe(PongSim* sim, int i) {
+    MatchBatch* mb = &sim->mb;
+    float* o = sim->obs + (size_t)i*PONGSIM_OBS_SIZE;
+    o[0] = real_to_float(mb->ball_x[i]);
+    o[1] = real_to_float(mb->ball_y[i]);
+    o[2] = real_to_float(mb->ball_xvel[i]);
+    o[3] = real_to_float(mb->ball_yvel[i]);
+    o[4] = real_to_float(mb->p1_y[i]);
+    o[5] = real_to_float(mb->p1_yvel[i]);
+    o[6] = real_to_float(mb->p2_y[i]);
+    o[7] = real_to_float(mb->p2_yvel[i]);
+}
+
+static void pongsim_reset_match(PongSim* sim, int i) {
+    batch_reset(&sim->mb, i);
+    sim->prev_p1_score[i] = 0;
+    sim->prev_p2_score[i] = 0;
+}
+
+PONGSIM_API PongSim* pongsim_create(int num_matches, uint64_t seed, int score_limit) {
+    if (num_matches <= 0) return NULL;
+    PongSim* sim = calloc(1, sizeof(PongSim));
+    if (sim == NULL) return NULL;
+
+    if (!batch_init(&sim->mb, num_matches, seed)) {
+        free(sim);
+        return NULL;
+    }
+    sim->kernel = batch_kernel();
+    sim->score_limit = score_limit;
+    sim->prev_p1_score = calloc(num_matches, sizeof(int));
+    sim->prev_p2_score = calloc(num_matches, sizeof(int));
+    if (sim->prev_p1_score == NULL || sim->prev_p2_score == NULL) {
+        pongsim_destroy(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+PONGSIM_API void pongsim_destroy(PongSim* sim) {
+    if (sim == NULL) return;
+    batch_release(&sim->mb);
+    free(sim->prev_p1_score);
+    free(sim->prev_p2_score);
+    free(sim);
+}
+
+PONGSIM_API int pongsim_num_matches(const PongSim* sim) {
+    return sim->mb.count;
+}
+
+PONGSIM_API void pongsim_bind(PongSim* sim, float* obs, float* reward, unsigned char* done) {
+    sim->obs = obs;
+    sim->reward = reward;
+    sim->done = done;
+    sim->needs_reset = true; // done[] is the caller's until reset_batch writes it
+}
+
+PONGSIM_API void pongsim_reset_batch(PongSim* sim) {
+    if (sim->obs == NULL) {
+        fprintf(stderr, "pongsim: reset before buffers were bound\n");
+        abort();
+    }
+    for (int i=0; i<sim->mb.count; i++) {
+        pongsim_reset_match(sim, i);
+        pongsim_observe(sim, i);
+        sim->reward[2*i] = 0.0f;
+        sim->reward[2*i+1] = 0.0f;
+        sim->done[i] = 0;
+    }
+    sim->needs_reset = false;
+}
+
+PONGSIM_API void pongsim_step_batch(PongSim* sim, const signed char* actions) {
+    MatchBatch* mb = &sim->mb;
+    if (sim->obs == NULL) {
+        fprintf(stderr, "pongsim: step before buffers were bound\n");
+        abort();
+    }
+    if (sim->needs_reset) {
+        fprintf(stderr, "pongsim: step before pongsim_reset_batch\n");
+        abort();
+    }
+
+    for (int i=0; i<mb->count; i++) {
+        if (sim->done[i]) pongsim_reset_match(sim, i);
+    }
+
+    sim->kernel(mb, actions, 0, mb->count);
+
+    for (int i=0; i<mb->count; i++) {
+        int p1_scored = mb->p1_score[i] - sim->prev_p1_score[i];
+        int p2_scored = mb->p2_score[i] - sim->prev_p2_score[i];
+        sim->prev_p1_score[i] = mb->p1_score[i];
+        sim->prev_p2_score[i] = mb->p2_score[i];
+
+        sim->reward[2*i] = (float)(p1_scored - p2_scored);
+        sim->reward[2*i+1] = (float)(p2_scored - p1_scored);
+        sim->done[i] = sim->score_limit > 0 &&
+                       (mb->p1_score[i] >= sim->score_limit || mb->p2_score[i] >= sim->score_limit);
+        pongsim_observe(sim, i);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef PONGSIM_H
+#define PONGSIM_H
+// Batched reinforcement-learning environment, built as libpongsim.so.
+//
+// A PongSim runs N independent computer-free matches. The caller owns the
+// observation, reward and done arrays and binds them once; every reset and
+// step writes its results straight into them, so stepping never allocates
+// or copies buffers. Matches that finished on the previous step are restarted
+// at the start of the next one.
+//
+// Per match i:
+//   obs[i*PONGSIM_OBS_SIZE ...]  ball x, y, x velocity, y velocity,
+//                                paddle 1 y, y velocity, paddle 2 y, y velocity
+//   reward[2*i], reward[2*i+1]   +1 to the player who scored this step, -1 to the other
+//   done[i]                      1 once either player reaches the score limit
+//   actions[2*i], actions[2*i+1] paddle 1 and 2 direction: 1 up, -1 down, 0 coast
+//
+// From Python, for example:
+//   sim = lib.pongsim_create(4096, seed, 11)
+//   lib.pongsim_bind(sim, obs.ctypes.data, reward.ctypes.data, done.ctypes.data)
+//   lib.pongsim_reset_batch(sim)
+//   lib.pongsim_step_batch(sim, actions.ctypes.data)
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PONGSIM_API
+#define PONGSIM_API
+#endif
+
+#define PONGSIM_OBS_SIZE 8
+
+typedef struct PongSim PongSim;
+
+// seed and match index fully determine a match, see rng.h. score_limit <= 0
+// means matches never end
+PONGSIM_API PongSim* pongsim_create(int num_matches, uint64_t seed, int score_limit);
+PONGSIM_API void pongsim_destroy(PongSim* sim);
+
+PONGSIM_API int pongsim_num_matches(const PongSim* sim);
+
+// obs: num_matches*PONGSIM_OBS_SIZE floats, reward: 2*num_matches floats,
+// done: num_matches bytes. must be bound before reset or step
+//
+// call order: create, bind, reset_batch, then any number of step_batch.
+// binding new buffers requires another reset_batch before the next step;
+// stepping without one aborts, since done[] would be uninitialized
+PONGSIM_API void pongsim_bind(PongSim* sim, float* obs, float* reward, unsigned char* done);
+
+// restart every match and write fresh observations
+PONGSIM_API void pongsim_reset_batch(PongSim* sim);
+
+// advance every match one tick. actions may be NULL to let the built-in
+// computer player control both paddles
+PONGSIM_API void pongsim_step_batch(PongSim* sim, const signed char* actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
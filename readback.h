@@ -0,0 +1,212 @@
+#ifndef READBACK_H
+#define READBACK_H
+// Asynchronous frame readback. readback_capture starts copying a framebuffer
+// into one of READBACK_FRAMES pixel buffer objects and fences it instead of
+// waiting for the pixels, so the GPU does the copy while later frames are
+// drawn. Frame N is collected once frame N+2 has been captured, or earlier
+// when its fence has already passed: the buffer is mapped, copied into a
+// free CPU frame and handed to a consumer thread, which does the slow part
+// (flipping, converting, encoding, writing) off the render thread. Frames
+// reach the consumer in capture order.
+#include <glad/glad.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define READBACK_FRAMES 3 // PBOs in flight
+#define READBACK_QUEUE 4  // CPU frames waiting for or held by the consumer
+
+// rgba is bottom row first, as GL reads it
+typedef void (*ReadbackConsumer)(void* user, const unsigned char* rgba, int width, int height, long frame);
+
+typedef struct ReadbackSlot {
+    unsigned int PBO;
+    size_t size;
+    GLsync fence; // NULL when the slot is free
+    int width, height;
+    long frame;
+} ReadbackSlot;
+
+typedef struct ReadbackFrame {
+    unsigned char* pixels;
+    size_t size;
+    int width, height;
+    long frame;
+} ReadbackFrame;
+
+typedef struct Readback {
+    ReadbackSlot slots[READBACK_FRAMES];
+    int head;    // next slot to capture into
+    long frames; // captured so far
+
+    // CPU frames: queue[first..first+queued) wait for the consumer, the rest are free
+    ReadbackFrame queue[READBACK_QUEUE];
+    int first, queued; // the consumer holds queue[first] while it runs
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready, space;
+    bool quit;
+    ReadbackConsumer consume;
+    void* user;
+
+    // render thread cost of capturing and collecting
+    double cpu_ms, max_ms;
+    unsigned int stalls; // waits for the GPU or the consumer
+} Readback;
+
+static double readback_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+static void* readback_worker(void* arg) {
+    Readback* rb = arg;
+    pthread_mutex_lock(&rb->lock);
+    while (true) {
+        while (!rb->quit && rb->queued == 0) pthread_cond_wait(&rb->ready, &rb->lock);
+        if (rb->queued == 0) break; // quit once drained
+        ReadbackFrame* f = &rb->queue[rb->first];
+        pthread_mutex_unlock(&rb->lock);
+
+        rb->consume(rb->user, f->pixels, f->width, f->height, f->frame);
+
+        pthread_mutex_lock(&rb->lock);
+        rb->first = (rb->first+1) % READBACK_QUEUE;
+        rb->queued--;
+        pthread_cond_signal(&rb->space);
+    }
+    pthread_mutex_unlock(&rb->lock);
+    return NULL;
+}
+
+void readback_init(Readback* rb, ReadbackConsumer consume, void* user) {
+    *rb = (Readback){.consume = consume, .user = user};
+    for (int i=0; i<READBACK_FRAMES; i++) glGenBuffers(1, &rb->slots[i].PBO);
+    pthread_mutex_init(&rb->lock, NULL);
+    pthread_cond_init(&rb->ready, NULL);
+    pthread_cond_init(&rb->space, NULL);
+    if (pthread_create(&rb->thread, NULL, readback_worker, rb) != 0) {
+        fprintf(stderr, "Readback: failed to start the consumer thread\n");
+        abort();
+    }
+}
+
+// copy a finished slot into the consumer's queue and free it
+static void readback_collect(Readback* rb, ReadbackSlot* slot) {
+    if (glClientWaitSync(slot->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        rb->stalls++;
+        glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    }
+    glDeleteSync(slot->fence);
+    slot->fence = NULL;
+
+    pthread_mutex_lock(&rb->lock);
+    if (rb->queued == READBACK_QUEUE) {
+        rb->stalls++;
+        while (rb->queued == READBACK_QUEUE) pthread_cond_wait(&rb->space, &rb->lock);
+    }
+    ReadbackFrame* f = &rb->queue[(rb->first + rb->queued) % READBACK_QUEUE];
+    pthread_mutex_unlock(&rb->lock);
+
+    // the frame is free, so the consumer will not touch it until it is queued
+    if (f->size < slot->size) {
+        free(f->pixels);
+        f->pixels = malloc(slot->size);
+        if (f->pixels == NULL) abort();
+        f->size = slot->size;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->PBO);
+    const void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot->size, GL_MAP_READ_BIT);
+    if (src != NULL) {
+        memcpy(f->pixels, src, slot->size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        memset(f->pixels, 0, slot->size);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    f->width = slot->width;
+    f->height = slot->height;
+    f->frame = slot->frame;
+
+    pthread_mutex_lock(&rb->lock);
+    rb->queued++;
+    pthread_cond_signal(&rb->ready);
+    pthread_mutex_unlock(&rb->lock);
+}
+
+// hand every frame whose copy has finished to the consumer, oldest first,
+// without waiting. frames older than wait_before are waited for
+static void readback_collect_ready(Readback* rb, long wait_before) {
+    for (int i=0; i<READBACK_FRAMES; i++) {
+        ReadbackSlot* slot = &rb->slots[(rb->head + i) % READBACK_FRAMES]; // oldest first
+        if (slot->fence == NULL) continue;
+        if (slot->frame >= wait_before && glClientWaitSync(slot->fence, 0, 0) == GL_TIMEOUT_EXPIRED) break;
+        readback_collect(rb, slot);
+    }
+}
+
+// start reading width by height pixels of framebuffer (0 for the back
+// buffer); call after the frame is drawn and before it is swapped
+void readback_capture(Readback* rb, unsigned int framebuffer, int width, int height) {
+    double start = readback_clock_ms();
+    ReadbackSlot* slot = &rb->slots[rb->head];
+    if (slot->fence != NULL) readback_collect(rb, slot); // only when frames are captured faster than collected
+
+    size_t size = (size_t)width*height*4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->PBO);
+    if (slot->size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot->size = size;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->width = width;
+    slot->height = height;
+    slot->frame = rb->frames++;
+    rb->head = (rb->head+1) % READBACK_FRAMES;
+
+    readback_collect_ready(rb, rb->frames-2);
+    double ms = readback_clock_ms() - start;
+    rb->cpu_ms += ms;
+    if (ms > rb->max_ms) rb->max_ms = ms;
+}
+
+// collect whatever has finished without waiting; for frames where nothing is captured
+void readback_poll(Readback* rb) {
+    double start = readback_clock_ms();
+    readback_collect_ready(rb, 0);
+    rb->cpu_ms += readback_clock_ms() - start;
+}
+
+// wait until every captured frame has been consumed
+void readback_finish(Readback* rb) {
+    readback_collect_ready(rb, rb->frames);
+    pthread_mutex_lock(&rb->lock);
+    while (rb->queued > 0) pthread_cond_wait(&rb->space, &rb->lock);
+    pthread_mutex_unlock(&rb->lock);
+}
+
+void readback_cleanup(Readback* rb) {
+    readback_finish(rb);
+    pthread_mutex_lock(&rb->lock);
+    rb->quit = true;
+    pthread_cond_signal(&rb->ready);
+    pthread_mutex_unlock(&rb->lock);
+    pthread_join(rb->thread, NULL);
+    pthread_mutex_destroy(&rb->lock);
+    pthread_cond_destroy(&rb->ready);
+    pthread_cond_destroy(&rb->space);
+    for (int i=0; i<READBACK_FRAMES; i++) glDeleteBuffers(1, &rb->slots[i].PBO);
+    for (int i=0; i<READBACK_QUEUE; i++) free(rb->queue[i].pixels);
+}
+
+#endif
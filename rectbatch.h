@@ -0,0 +1,148 @@
+#ifndef RECTBATCH_H
+#define RECTBATCH_H
+// Instanced rectangle renderer. Every rectangle in a frame (paddles, ball,
+// court border, centre-line dashes) is one instance of the unit quad mesh:
+// rectbatch_add appends its centre, half extents, rotation and color to
+// per-field arrays, and rectbatch_draw turns them into instance transforms
+// in one pass of xform_batch, written straight into the frame's stream
+// buffer range, then issues a single glDrawElementsInstanced. The number of
+// GL calls per frame stays the same however many rectangles there are.
+#include <glad/glad.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <cglm/cglm.h>
+
+#include "glstate.h"
+#include "shapes.h"
+#include "stream.h"
+#include "xform.h"
+
+#define RECTBATCH_MIN_CAPACITY 64
+
+// per-instance vertex data
+typedef struct RectInstance {
+    Xform2D xform;
+    float r, g, b;
+} RectInstance;
+
+typedef struct RectBatch {
+    unsigned int VAO; // unit quad buffers plus instances from the stream
+    StreamBuffer* stream;
+    float *x, *y, *half_w, *half_h, *rot;
+    vec3* color;
+    int count, capacity;
+} RectBatch;
+
+static void rectbatch_reserve(RectBatch* batch, int capacity) {
+    float** fields[] = {&batch->x, &batch->y, &batch->half_w, &batch->half_h, &batch->rot};
+    for (int i=0; i<5; i++) {
+        *fields[i] = realloc(*fields[i], capacity*sizeof(float));
+        if (*fields[i] == NULL) abort();
+    }
+    batch->color = realloc(batch->color, capacity*sizeof(vec3));
+    if (batch->color == NULL) abort();
+    batch->capacity = capacity;
+}
+
+// quad is the registry's unit quad; instances are streamed through stream
+void rectbatch_init(RectBatch* batch, VertexObject* quad, StreamBuffer* stream, int capacity) {
+    if (capacity < RECTBATCH_MIN_CAPACITY) capacity = RECTBATCH_MIN_CAPACITY;
+    *batch = (RectBatch){0};
+    rectbatch_reserve(batch, capacity);
+    batch->stream = stream;
+
+    glGenVertexArrays(1, &batch->VAO);
+
+    glstate_bind_vertex_array(batch->VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, quad->VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad->EBO);
+
+    // corner attribute, per vertex: x and y of the quad's colored vertices
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // centre, basis and color attributes, per instance. they point into the
+    // stream at draw time
+    for (int i=1; i<=3; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    glstate_bind_vertex_array(0);
+}
+
+// start collecting a new frame
+void rectbatch_begin(RectBatch* batch) {
+    batch->count = 0;
+}
+
+void rectbatch_add(RectBatch* batch, float x, float y, float half_w, float half_h, float rot, vec3 color) {
+    if (batch->count == batch->capacity) rectbatch_reserve(batch, batch->capacity*2);
+    int i = batch->count++;
+    batch->x[i] = x;
+    batch->y[i] = y;
+    batch->half_w[i] = half_w;
+    batch->half_h[i] = half_h;
+    batch->rot[i] = rot;
+    memcpy(batch->color[i], color, sizeof(vec3));
+}
+
+// rectangular frame of the given outer half extents, as four rects
+void rectbatch_outline(RectBatch* batch, float x, float y, float half_w, float half_h, float border, vec3 color) {
+    float b = border/2.0f;
+    rectbatch_add(batch, x, y+half_h-b, half_w, b, 0.0f, color); // top
+    rectbatch_add(batch, x, y-half_h+b, half_w, b, 0.0f, color); // bottom
+    rectbatch_add(batch, x-half_w+b, y, b, half_h-border, 0.0f, color); // left
+    rectbatch_add(batch, x+half_w-b, y, b, half_h-border, 0.0f, color); // right
+}
+
+// vertical dashed line centred on (x, y), one rect per dash
+void rectbatch_dashed_line(RectBatch* batch, float x, float y, float length, float half_w, int dashes, float spacing, vec3 color) {
+    float full_dash = length/(float)dashes;
+    float half_dash = (full_dash-spacing)/2.0f;
+    for (int i=0; i<dashes; i++) {
+        rectbatch_add(batch, x, y - length/2.0f + full_dash*(i+0.5f), half_w, half_dash, 0.0f, color);
+    }
+}
+
+// build this frame's instances in the stream and draw them all with one call.
+// the view-projection comes from the Camera uniform block
+void rectbatch_draw(RectBatch* batch, int fillmode, unsigned int shader_program) {
+    if (batch->count == 0) return;
+
+    size_t offset;
+    RectInstance* instances = stream_alloc(batch->stream, batch->count*sizeof(RectInstance), &offset);
+    xform_batch(batch->x, batch->y, batch->rot, batch->half_w, batch->half_h, batch->count, instances, sizeof(RectInstance));
+    for (int i=0; i<batch->count; i++) {
+        instances[i].r = batch->color[i][0];
+        instances[i].g = batch->color[i][1];
+        instances[i].b = batch->color[i][2];
+    }
+    stream_flush(batch->stream);
+
+    glstate_use_program(shader_program);
+    glstate_polygon_mode(fillmode);
+    glstate_bind_vertex_array(batch->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->stream->buffer);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(RectInstance), (void*)(offset + offsetof(RectInstance, xform.x)));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(RectInstance), (void*)(offset + offsetof(RectInstance, xform.ax)));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(RectInstance), (void*)(offset + offsetof(RectInstance, r)));
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, batch->count);
+}
+
+void rectbatch_cleanup(RectBatch* batch) {
+    if (glstate.vertex_array == batch->VAO) glstate_invalidate();
+    glDeleteVertexArrays(1, &batch->VAO);
+    free(batch->x);
+    free(batch->y);
+    free(batch->half_w);
+    free(batch->half_h);
+    free(batch->rot);
+    free(batch->color);
+    batch->x = batch->y = batch->half_w = batch->half_h = batch->rot = NULL;
+    batch->color = NULL;
+}
+
+#endif
@@ -9,55 +9,112 @@
 #include <cglm/cglm.h>
 #include <cglm/call.h>
 
-#include "gameobjects.h"
+#include "shapes.h"
+#include "glstate.h"
+#include "xform.h"
+
+typedef struct Object {
+    VertexObject* vertobj;
+    float xpos, ypos, rot;
+    float xscale, yscale;
+    vec3 color;
+} Object;
+
+Object* mkObject(Pool* pool, VertexObject* vertobj, float x, float y) {
+    Object* object = pool_alloc(pool);
+    *object = (Object){vertobj, x, y, 0.0f, 1.0f, 1.0f, {1.0f, 1.0f, 1.0f}};
+    return object;
+}
+
+struct GlyphAtlas;
+struct TextMesh;
+
+// A renderer other than GL, such as the CPU rasterizer in swraster.h. While
+// render_backend points at one, render_begin, render_objects, render_end
+// and text_draw hand it the frame instead of drawing it with GL.
+typedef struct RenderBackend {
+    void* self;
+    void (*begin)(void* self, float r, float g, float b);
+    void (*objects)(void* self, Object* objects, int count);
+    void (*text)(void* self, struct GlyphAtlas* atlas, struct TextMesh** meshes, int count);
+    void (*end)(void* self);
+} RenderBackend;
+
+RenderBackend* render_backend = NULL;
 
-extern unsigned int SCR_WIDTH;
-extern unsigned int SCR_HEIGHT;
+// pair a mesh with the transform of a simulated Player or Ball, drawn w by h and white
+#define OBJECT(mesh, o, w, h) ((Object){(mesh), real_to_float((o)->xpos), real_to_float((o)->ypos), real_to_float((o)->rot), (w), (h), {1.0f, 1.0f, 1.0f}})
 
 void draw(VertexObject* vertobj, int fillmode) {
-    glPolygonMode(GL_FRONT_AND_BACK, fillmode);
-    glBindVertexArray(vertobj->VAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
+    glstate_polygon_mode(fillmode);
+    glstate_bind_vertex_array(vertobj->VAO);
     glDrawElements(GL_TRIANGLES, vertobj->vert_count, GL_UNSIGNED_INT, NULL);
-    glBindVertexArray(0); // no need to unbind it every time 
 }
 
-void useShader(unsigned int shader_program, vec3 pos) {
-    glUseProgram(shader_program);
+void useShader(unsigned int shader_program, vec3 pos, vec3 color) {
+    glstate_use_program(shader_program);
 
-    unsigned int transformLoc = glGetUniformLocation(shader_program, "transform");
+    int transformLoc = glstate_uniform_location(shader_program, "transform");
     glUniformMatrix4fv(transformLoc, 1, GL_FALSE, pos);
+    glUniform3fv(glstate_uniform_location(shader_program, "tint"), 1, color);
 }
 
 void render_begin() {
+    if (render_backend != NULL) {
+        render_backend->begin(render_backend->self, 0.1f, 0.1f, 0.1f);
+        return;
+    }
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
-void render(Object* gameobject, int fillmode, unsigned int shader_program) {
-    VertexObject* vertobj = gameobject->vertobj;
-    if (vertobj->texture == 1) {
-        glBindTexture(GL_TEXTURE_2D, vertobj->texture);
+// draw objects one by one, with every model matrix computed up front in one
+// pass; the view-projection comes from the Camera uniform block
+void render_objects(Object* objects, int count, int fillmode, unsigned int shader_program) {
+    if (render_backend != NULL) {
+        render_backend->objects(render_backend->self, objects, count);
+        return;
     }
+    float x[count], y[count], rot[count], xscale[count], yscale[count];
+    Xform2D xforms[count];
+    for (int i=0; i<count; i++) {
+        x[i] = objects[i].xpos;
+        y[i] = objects[i].ypos;
+        rot[i] = objects[i].rot;
+        xscale[i] = objects[i].xscale;
+        yscale[i] = objects[i].yscale;
+    }
+    xform_batch(x, y, rot, xscale, yscale, count, xforms, sizeof(Xform2D));
+
+    for (int i=0; i<count; i++) {
+        VertexObject* vertobj = objects[i].vertobj;
+        if (vertobj->texture != 0) {
+            glstate_bind_texture(vertobj->texture);
+        }
+        mat4 model;
+        xform_to_mat4(&xforms[i], model);
+        useShader(shader_program, model[0], objects[i].color);
+        draw(vertobj, fillmode);
+    }
+}
 
-    mat4 trans = GLM_MAT4_IDENTITY_INIT;
-    glm_ortho_default(((float)SCR_WIDTH/SCR_HEIGHT), trans);
-    glm_translate(trans, (vec3){gameobject->xpos, gameobject->ypos, 0.0f});
-    glm_rotate(trans, gameobject->rot, GLM_ZUP);
-
-    // glm_scale(trans, (vec3){0.2f, 0.2f, 0.2f});
+void render(Object* gameobject, int fillmode, unsigned int shader_program) {
+    render_objects(gameobject, 1, fillmode, shader_program);
+}
 
-    useShader(shader_program, trans[0]);
-    draw(vertobj, fillmode);
+// an object between its state at the previous tick and the current one
+Object lerp_object(const Object* prev, const Object* gameobject, float alpha) {
+    Object interp = *gameobject;
+    interp.xpos = prev->xpos + (gameobject->xpos - prev->xpos)*alpha;
+    interp.ypos = prev->ypos + (gameobject->ypos - prev->ypos)*alpha;
+    interp.rot  = prev->rot  + (gameobject->rot  - prev->rot )*alpha;
+    return interp;
 }
 
+// a backend finishes and shows its frame here
 void render_end() {
-
+    if (render_backend != NULL) render_backend->end(render_backend->self);
 }
 
-void render_cleanup(VertexObject* vertobj) {
-    glDeleteVertexArrays(1, &(vertobj->VAO));
-    glDeleteBuffers(1, &(vertobj->VBO));
-    glDeleteBuffers(1, &(vertobj->EBO));
-}
 
 #endif
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+
+out vec3 ourColor;
+
+uniform mat4 transform;
+uniform vec3 tint;
+
+layout (std140) uniform Camera {
+	mat4 view_projection;
+};
+
+void main() {
+	gl_Position = view_projection * transform * vec4(aPos, 1.0f);	
+	ourColor = aColor * tint;
+}
\ No newline at end of file
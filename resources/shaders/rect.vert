@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec2 aCentre;
+layout (location = 2) in vec4 aBasis; // x axis, y axis: rotation and half extents
+layout (location = 3) in vec3 aColor;
+
+out vec3 ourColor;
+
+layout (std140) uniform Camera {
+	mat4 view_projection;
+};
+
+void main() {
+	vec2 p = aCentre + aCorner.x*aBasis.xy + aCorner.y*aBasis.zw;
+	gl_Position = view_projection * vec4(p, 0.0f, 1.0f);
+	ourColor = aColor;
+}
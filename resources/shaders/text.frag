@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoord;
+in vec3 ourColor;
+
+uniform sampler2D atlas;
+
+void main()
+{
+	FragColor = vec4(ourColor, texture(atlas, TexCoord).r);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec3 aColor;
+
+out vec2 TexCoord;
+out vec3 ourColor;
+
+layout (std140) uniform Camera {
+	mat4 view_projection;
+};
+
+void main() {
+	gl_Position = view_projection * vec4(aPos, 0.0f, 1.0f);
+	TexCoord = aTexCoord;
+	ourColor = aColor;
+}
@@ -0,0 +1,37 @@
+#ifndef RNG_H
+#define RNG_H
+// Counter-based random numbers. There is no generator state: the nth number
+// of a stream is a pure function of (key, n), so every match can draw from
+// its own stream on any thread, in any order, and replay exactly. Keys come
+// from (seed, match id); the mixing function is the SplitMix64 finalizer.
+#include <stdint.h>
+
+#define RNG_GAMMA 0x9E3779B97F4A7C15ull
+
+static inline uint64_t rng_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// stream key for one match
+static inline uint64_t rng_key(uint64_t seed, uint64_t match_id) {
+    return rng_mix(seed ^ rng_mix((match_id+1)*RNG_GAMMA));
+}
+
+// the nth 64-bit value of a stream
+static inline uint64_t rng_u64(uint64_t key, uint64_t n) {
+    return rng_mix(key + (n+1)*RNG_GAMMA);
+}
+
+// uniform in [0, 1)
+static inline float rng_float(uint64_t key, uint64_t n) {
+    return (rng_u64(key, n) >> 40) * (1.0f/16777216.0f);
+}
+
+// uniform in [-1, 1)
+static inline float rng_signed(uint64_t key, uint64_t n) {
+    return rng_float(key, n)*2.0f - 1.0f;
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+// Multithreaded match runner. A MatchBatch is cut into shards of matches,
+// the shards are dealt round-robin onto per-worker Chase-Lev deques, and each
+// worker pops its own shards from the bottom and steals from the top of the
+// others' when it runs dry. A shard is stepped for the whole tick count
+// before the next one is taken, so its state stays in that core's cache.
+// With a wall-clock budget, shards also stop between chunks of ticks once it
+// expires and no further shards are taken; the report then shows how many
+// match ticks completed.
+//
+// Requires matches.h.
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHARD_ALIGN 16 // matches; keeps shards on separate cache lines
+#define STEAL_ATTEMPTS 64
+#define BUDGET_CHECK_TICKS 64 // ticks stepped between looks at the clock
+
+typedef struct Shard {
+    int first, last;
+} Shard;
+
+// fixed-capacity work-stealing deque, filled before the workers start
+typedef struct Deque {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    Shard* shards;
+    long mask;
+} Deque;
+
+void deque_init(Deque* d, long capacity) {
+    long size = 1;
+    while (size < capacity) size <<= 1;
+    d->shards = malloc(size*sizeof(Shard));
+    if (d->shards == NULL) abort();
+    d->mask = size-1;
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+}
+
+void deque_push(Deque* d, Shard s) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    d->shards[b & d->mask] = s;
+    atomic_store_explicit(&d->bottom, b+1, memory_order_release);
+}
+
+// owner end
+bool deque_pop(Deque* d, Shard* out) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+        return false;
+    }
+    *out = d->shards[b & d->mask];
+    if (t == b) {
+        // last shard: race the thieves for it
+        bool won = atomic_compare_exchange_strong_explicit(&d->top, &t, t+1,
+                       memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+// thief end
+bool deque_steal(Deque* d, Shard* out) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return false;
+
+    Shard s = d->shards[t & d->mask];
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t+1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return false;
+    }
+    *out = s;
+    return true;
+}
+
+typedef struct Worker {
+    _Alignas(64) Deque deque;
+    struct Runner* runner;
+    pthread_t thread;
+    int id;
+    unsigned int rng; // victim selection
+
+    // stats
+    long shards_run, steals;
+    long match_ticks; // matches times ticks stepped
+    double busy;
+} Worker;
+
+typedef struct Runner {
+    MatchBatch* mb;
+    BatchKernel kernel;
+    long ticks;
+    double deadline; // runner_clock time to stop at, 0 for none
+
+    int worker_count;
+    Worker* workers;
+    atomic_long remaining; // shards not yet completed
+    double wall;
+} Runner;
+
+double runner_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+bool runner_take(Worker* w, Shard* s) {
+    if (deque_pop(&w->deque, s)) return true;
+
+    Runner* r = w->runner;
+    for (int attempt=0; attempt<STEAL_ATTEMPTS; attempt++) {
+        w->rng ^= w->rng << 13;
+        w->rng ^= w->rng >> 17;
+        w->rng ^= w->rng << 5;
+        Worker* victim = &r->workers[w->rng % r->worker_count];
+        if (victim != w && deque_steal(&victim->deque, s)) {
+            w->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void* runner_worker(void* arg) {
+    Worker* w = arg;
+    Runner* r = w->runner;
+
+    while (atomic_load_explicit(&r->remaining, memory_order_acquire) > 0) {
+        if (r->deadline > 0 && runner_clock() >= r->deadline) break;
+        Shard s;
+        if (!runner_take(w, &s)) {
+            sched_yield();
+            continue;
+        }
+
+        double start = runner_clock();
+        long t = 0;
+        while (t < r->ticks) {
+            long chunk = r->ticks-t < BUDGET_CHECK_TICKS ? r->ticks-t : BUDGET_CHECK_TICKS;
+            for (long i=0; i<chunk; i++) {
+                r->kernel(r->mb, NULL, s.first, s.last);
+            }
+            t += chunk;
+            if (r->deadline > 0 && runner_clock() >= r->deadline) break;
+        }
+        w->busy += runner_clock() - start;
+        w->match_ticks += t*(s.last-s.first);
+        w->shards_run++;
+
+        // shard completed
+        atomic_fetch_sub_explicit(&r->remaining, 1, memory_order_release);
+    }
+    return NULL;
+}
+
+// step every match in mb for ticks ticks using worker_count threads (0 means
+// one per online CPU), shard_size matches at a time. budget > 0 stops after
+// that many seconds even if matches are left short of ticks
+Runner* runMatches(MatchBatch* mb, BatchKernel kernel, long ticks, double budget, int worker_count, int shard_size) {
+    if (worker_count <= 0) worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_count <= 0) worker_count = 1;
+    if (shard_size <= 0) shard_size = SHARD_ALIGN;
+    if (shard_size > mb->count) shard_size = mb->count; // also keeps the rounding below from overflowing
+    shard_size = (shard_size+SHARD_ALIGN-1) / SHARD_ALIGN * SHARD_ALIGN;
+
+    Runner* r = calloc(1, sizeof(Runner));
+    if (r == NULL) abort();
+    r->mb = mb;
+    r->kernel = kernel;
+    r->ticks = ticks;
+    r->worker_count = worker_count;
+    r->workers = aligned_alloc(64, worker_count*sizeof(Worker));
+    if (r->workers == NULL) abort();
+
+    long shard_count = (mb->count+shard_size-1) / shard_size;
+    for (int i=0; i<worker_count; i++) {
+        Worker* w = &r->workers[i];
+        memset(w, 0, sizeof *w);
+        deque_init(&w->deque, shard_count/worker_count+1);
+        w->runner = r;
+        w->id = i;
+        w->rng = 2463534242u + i*2654435761u;
+    }
+    for (long s=0; s<shard_count; s++) {
+        int first = s*shard_size;
+        int last = first+shard_size < mb->count ? first+shard_size : mb->count;
+        deque_push(&r->workers[s % worker_count].deque, (Shard){first, last});
+    }
+    atomic_init(&r->remaining, shard_count);
+
+    double start = runner_clock();
+    r->deadline = budget > 0 ? start + budget : 0;
+    for (int i=1; i<worker_count; i++) {
+        if (pthread_create(&r->workers[i].thread, NULL, runner_worker, &r->workers[i]) != 0) {
+            fprintf(stderr, "Failed to start worker %d\n", i);
+            abort();
+        }
+    }
+    runner_worker(&r->workers[0]); // the calling thread is worker 0
+    for (int i=1; i<worker_count; i++) {
+        pthread_join(r->workers[i].thread, NULL);
+    }
+    r->wall = runner_clock() - start;
+    return r;
+}
+
+// matches times ticks stepped by every worker
+long runner_match_ticks(Runner* r) {
+    long total = 0;
+    for (int i=0; i<r->worker_count; i++) total += r->workers[i].match_ticks;
+    return total;
+}
+
+void runner_report(Runner* r, FILE* out) {
+    long total = runner_match_ticks(r);
+    long planned = (long)r->mb->count*r->ticks;
+    fprintf(out, "%d workers: %.2f Mticks/s aggregate", r->worker_count, total/r->wall/1e6);
+    if (total < planned) fprintf(out, ", budget expired after %ld of %ld match ticks", total, planned);
+    fprintf(out, "\n");
+    for (int i=0; i<r->worker_count; i++) {
+        Worker* w = &r->workers[i];
+        fprintf(out, "  worker %2d: %5ld shards, %4ld stolen, %5.1f%% busy\n",
+                i, w->shards_run, w->steals, 100.0*w->busy/r->wall);
+    }
+}
+
+void freeRunner(Runner* r) {
+    for (int i=0; i<r->worker_count; i++) {
+        free(r->workers[i].deque.shards);
+    }
+    free(r->workers);
+    free(r);
+}
+
+#endif
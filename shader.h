@@ -1,13 +1,19 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <errno.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/mman.h>
 #include <glad/glad.h>
 #include <glib.h>
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "glstate.h"
 
 const char* fileExt(const char *filename) {
     const char *dot = strrchr(filename, '.');
@@ -15,97 +21,456 @@ const char* fileExt(const char *filename) {
     return dot + 1;
 }
 
-void* readFile(const char* filepath) {
-    int fd = open(filepath, O_RDONLY);
-    int len = lseek(fd, 0, SEEK_END);
-    return mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+// Program binary cache. A linked program is saved with glGetProgramBinary
+// under a key hashed from its shader sources and the GL vendor, renderer and
+// version, and later runs load it with glProgramBinary instead of compiling.
+// A driver update or an edited shader changes the key; a binary the driver
+// rejects anyway is recompiled from source and replaced.
+#define PROGRAM_CACHE_MAGIC 0x42534750u // "PGSB"
+
+typedef struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint32_t length;
+    uint32_t reserved; // 0; spells out what would be padding
+} ProgramCacheHeader;
+
+// set by programCacheInit; only read afterwards, including by the hot reload thread
+bool programCacheEnabled = false;
+
+// resolve the program binary entry points and check the driver has a binary
+// format. call once on the main thread after GL is loaded
+void programCacheInit() {
+    programCacheEnabled = false;
+    if (!GLAD_GL_VERSION_4_1 && !glstate_has_extension("GL_ARB_get_program_binary")) return;
+    // glad only loads core entry points; the ARB names are the same
+    if (glGetProgramBinary == NULL) {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glstate_get_proc("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)glstate_get_proc("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glstate_get_proc("glProgramParameteri");
+    }
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    programCacheEnabled = formats > 0 && glGetProgramBinary != NULL && glProgramBinary != NULL;
+}
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i=0; i<len; i++) h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+// key for a program linked from these sources on the current driver
+uint64_t programKey(int count, char** names, char** sources) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (int i=0; i<3; i++) {
+        const char* s = (const char*)glGetString(strings[i]);
+        if (s) h = fnv1a(h, s, strlen(s)+1);
+    }
+    for (int i=0; i<count; i++) {
+        h = fnv1a(h, names[i], strlen(names[i])+1);
+        h = fnv1a(h, sources[i], strlen(sources[i])+1);
+    }
+    return h;
+}
+
+// $PONG_SHADER_CACHE, else $XDG_CACHE_HOME/pong-gl, else ~/.cache/pong-gl
+static bool programCacheDir(char* dir, size_t size) {
+    const char* env = getenv("PONG_SHADER_CACHE");
+    if (env) {
+        snprintf(dir, size, "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME")) != NULL) {
+        snprintf(dir, size, "%s/pong-gl", env);
+    } else if ((env = getenv("HOME")) != NULL) {
+        snprintf(dir, size, "%s/.cache/pong-gl", env);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool programCachePath(uint64_t key, char* path, size_t size) {
+    char dir[4096];
+    if (!programCacheDir(dir, sizeof(dir))) return false;
+    snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+    return true;
+}
+
+// create the cache directory and any missing parents
+static bool makeProgramCacheDir() {
+    char dir[4096];
+    if (!programCacheDir(dir, sizeof(dir))) return false;
+    for (char* p = dir+1; ; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char c = *p;
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Shader cache: cannot create %s: %s\n", dir, strerror(errno));
+            return false;
+        }
+        if (c == '\0') return true;
+        *p = c;
+    }
+}
+
+// a program from the cache, or 0 if there is no usable binary for key
+unsigned int loadProgramBinary(uint64_t key) {
+    char path[4200];
+    if (!programCachePath(key, path, sizeof(path))) return 0;
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return 0;
+
+    // the binary must fill the rest of the file exactly, so a truncated or
+    // corrupt entry can't ask for an arbitrary allocation
+    struct stat st;
+    ProgramCacheHeader header;
+    void* binary = NULL;
+    unsigned int program = 0;
+    if (fstat(fileno(f), &st) == 0 && fread(&header, sizeof(header), 1, f) == 1 &&
+        header.magic == PROGRAM_CACHE_MAGIC && header.key == key && header.reserved == 0 &&
+        header.length > 0 && header.length == (uint64_t)st.st_size - sizeof(header) &&
+        (binary = malloc(header.length)) != NULL && fread(binary, 1, header.length, f) == header.length) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, header.length);
+        int success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // stale: the driver no longer accepts this binary
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    free(binary);
+    fclose(f);
+    return program;
+}
+
+void saveProgramBinary(unsigned int program, uint64_t key) {
+    char path[4200], tmp[4210];
+    if (!programCachePath(key, path, sizeof(path))) return;
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    void* binary = malloc(length);
+    if (binary == NULL) return;
+    ProgramCacheHeader header = {PROGRAM_CACHE_MAGIC, 0, key, 0, 0};
+    glGetProgramBinary(program, length, &length, &header.format, binary);
+    header.length = length;
+
+    // write then rename, so a concurrent run never reads half a file
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (f == NULL && errno == ENOENT && makeProgramCacheDir()) f = fopen(tmp, "wb"); // first save
+    if (f != NULL) {
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(binary, 1, length, f) == (size_t)length;
+        ok = fclose(f) == 0 && ok;
+        if (ok) rename(tmp, path);
+        else unlink(tmp);
+    }
+    free(binary);
+}
+
+// Shader library. Every .vert, .frag and .geom file in the directory belongs
+// to the program named by its base name (color.vert + color.frag make
+// "color"), so pipelines and their variants live side by side and are looked
+// up by name. Programs are built together: every compile and link is issued
+// before any status is read, which lets a driver with
+// GL_KHR_parallel_shader_compile work on all of them at once. Each program
+// records how long its compile and link took.
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+#endif
+
+typedef struct ShaderTiming {
+    double compile_ms; // issuing the compiles
+    double link_ms;    // issuing the link
+    double ready_ms;   // from the first compile until the program was usable
+    bool from_cache;
+} ShaderTiming;
+
+typedef struct ShaderProgram {
+    char* name;
+    char** files;
+    int file_count;
+    unsigned int program; // replaced in place on hot reload
+    ShaderTiming timing;
+} ShaderProgram;
+
+typedef struct ShaderLibrary {
+    char* dir;
+    const Archive* archive; // sources come from here when it has the directory
+    ShaderProgram* programs;
+    int count;
+    bool parallel; // GL_KHR_parallel_shader_compile in use
+} ShaderLibrary;
+
+static double shaderClockMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+static unsigned int shaderType(const char* filename) {
+    const char* ext = fileExt(filename);
+    if (strcmp(ext,"vert") == 0) return GL_VERTEX_SHADER;
+    if (strcmp(ext,"frag") == 0) return GL_FRAGMENT_SHADER;
+    if (strcmp(ext,"geom") == 0) return GL_GEOMETRY_SHADER;
+    return 0;
+}
+
+static int compareNames(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int comparePrograms(const void* a, const void* b) {
+    return strcmp(((const ShaderProgram*)a)->name, ((const ShaderProgram*)b)->name);
 }
 
-unsigned int compileShader(const char* shader_source, unsigned int shader_type) {
-    // build and compile our shader program
-    unsigned int shader = glCreateShader(shader_type); // Pointer to shader. Given shader_type: GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
-    glShaderSource(shader, 1, &shader_source, NULL);
-    glCompileShader(shader);
+// let the driver compile on as many threads as it likes, if it can
+static bool enableParallelCompile() {
+    if (!glstate_has_extension("GL_KHR_parallel_shader_compile")) return false;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glstate_get_proc("glMaxShaderCompilerThreadsKHR");
+    if (max_threads) max_threads(0xFFFFFFFF);
+    return true;
+}
 
-    // check for shader compile errors
+static bool checkShader(unsigned int shader, const char* name) {
     int success;
     char infoLog[512];
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
         glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        printf("ERROR::SHADER::COMPILATION_FAILED\n%s\n", infoLog);
+        printf("ERROR::SHADER::COMPILATION_FAILED %s\n%s\n", name, infoLog);
     }
-    return shader;
+    return success;
 }
 
-unsigned int linkShaders(int argc, unsigned int* shaders) {
-    unsigned int shader_program = glCreateProgram();
-    for (int i=0;i<argc;i++) {
-        glAttachShader(shader_program, shaders[i]);
-    }
-    glLinkProgram(shader_program);
-
-    // check for linking errors
+static bool checkProgram(unsigned int program, const char* name) {
     int success;
     char infoLog[512];
-    glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(shader_program, 512, NULL, infoLog);
-        printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        printf("ERROR::SHADER::PROGRAM::LINKING_FAILED %s\n%s\n", name, infoLog);
     }
+    return success;
+}
+
+// build count programs from their files in dir, read from archive or, when
+// it is NULL or lacks them, from disk. out[i] gets the new program object,
+// or 0 if it failed to build. nothing is installed
+void buildPrograms(const Archive* archive, const char* dir, ShaderProgram* programs, int count, bool parallel,
+                   unsigned int* out, ShaderTiming* timings) {
+    if (count == 0) return;
+    Asset* assets[count];
+    char** sources[count];
+    unsigned int* shaders[count];
+    uint64_t keys[count];
+    double start[count];
+    bool cache = programCacheEnabled;
 
-    for (int i=0;i<argc;i++) {
-        glDeleteShader(shaders[i]);
+    for (int p=0; p<count; p++) {
+        ShaderProgram* sp = &programs[p];
+        timings[p] = (ShaderTiming){0};
+        start[p] = shaderClockMs();
+        assets[p] = malloc(sp->file_count*sizeof(Asset));
+        sources[p] = malloc(sp->file_count*sizeof(char*));
+        shaders[p] = calloc(sp->file_count, sizeof(unsigned int));
+        if (assets[p] == NULL || sources[p] == NULL || shaders[p] == NULL) abort();
+        for (int f=0; f<sp->file_count; f++) {
+            char full_path[strlen(dir)+strlen(sp->files[f])+2];
+            snprintf(full_path, sizeof(full_path), "%s%s%s", dir, dir[strlen(dir)-1] == '/' ? "" : "/", sp->files[f]);
+            if (!asset_load(archive, full_path, &assets[p][f])) {
+                printf("ERROR::SHADER::FILE_NOT_READ %s\n", full_path);
+                assets[p][f] = (Asset){"", 0, false}; // fails to compile and is reported below
+            }
+            sources[p][f] = (char*)assets[p][f].data;
+        }
+        keys[p] = cache ? programKey(sp->file_count, sp->files, sources[p]) : 0;
+        out[p] = cache ? loadProgramBinary(keys[p]) : 0;
+        if (out[p] != 0) {
+            timings[p].from_cache = true;
+            timings[p].ready_ms = shaderClockMs() - start[p];
+        }
+    }
+
+    // issue every compile, then every link, without waiting on any of them
+    for (int p=0; p<count; p++) {
+        if (out[p] != 0) continue;
+        ShaderProgram* sp = &programs[p];
+        double t = shaderClockMs();
+        for (int f=0; f<sp->file_count; f++) {
+            const char* source = sources[p][f];
+            shaders[p][f] = glCreateShader(shaderType(sp->files[f]));
+            glShaderSource(shaders[p][f], 1, &source, NULL);
+            glCompileShader(shaders[p][f]);
+        }
+        timings[p].compile_ms = shaderClockMs() - t;
+    }
+    for (int p=0; p<count; p++) {
+        if (out[p] != 0) continue;
+        ShaderProgram* sp = &programs[p];
+        double t = shaderClockMs();
+        out[p] = glCreateProgram();
+        for (int f=0; f<sp->file_count; f++) glAttachShader(out[p], shaders[p][f]);
+        if (glProgramParameteri) glProgramParameteri(out[p], GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(out[p]);
+        timings[p].link_ms = shaderClockMs() - t;
     }
 
-    return shader_program;
+    // collect programs as they finish; without the extension the first query blocks
+    int waiting = 0;
+    bool done[count];
+    for (int p=0; p<count; p++) {
+        done[p] = timings[p].from_cache;
+        if (!done[p]) waiting++;
+    }
+    while (waiting > 0) {
+        for (int p=0; p<count; p++) {
+            if (done[p]) continue;
+            int complete = 1;
+            if (parallel) glGetProgramiv(out[p], GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete) continue;
+
+            ShaderProgram* sp = &programs[p];
+            bool ok = true;
+            for (int f=0; f<sp->file_count; f++) ok = checkShader(shaders[p][f], sp->files[f]) && ok;
+            ok = checkProgram(out[p], sp->name) && ok;
+            timings[p].ready_ms = shaderClockMs() - start[p];
+            if (ok && cache) saveProgramBinary(out[p], keys[p]);
+            if (!ok) {
+                glDeleteProgram(out[p]);
+                out[p] = 0;
+            }
+            done[p] = true;
+            waiting--;
+        }
+        if (waiting > 0) usleep(100);
+    }
+
+    for (int p=0; p<count; p++) {
+        for (int f=0; f<programs[p].file_count; f++) {
+            if (shaders[p][f] != 0) glDeleteShader(shaders[p][f]);
+            asset_release(&assets[p][f]);
+        }
+        free(assets[p]);
+        free(sources[p]);
+        free(shaders[p]);
+    }
 }
 
-// Returns a shader program or 0
-unsigned int loadShaders(const char* shader_path) {
-    GError *err = NULL;
-    GDir* shadir = g_dir_open(shader_path, 0, &err);
-    unsigned int shaders[64]; // Hardcoded shader max count
-    shaders[0] = 0;
-    int shader_count = 0;
-    unsigned int shader_program;
+static void shaderLibraryAdd(ShaderLibrary* lib, const char* filename, int* capacity) {
+    if (shaderType(filename) == 0) return;
 
-    if (err != NULL) {
-        fprintf(stderr, "Unable to list files in dir \"%s\": %s\n", shader_path, err->message);
-        g_error_free(err);
+    size_t base_len = strcspn(filename, ".");
+    ShaderProgram* sp = NULL;
+    for (int i=0; i<lib->count; i++) {
+        if (strlen(lib->programs[i].name) == base_len && strncmp(lib->programs[i].name, filename, base_len) == 0)
+            sp = &lib->programs[i];
+    }
+    if (sp == NULL) {
+        if (lib->count == *capacity) {
+            *capacity = *capacity ? *capacity*2 : 8;
+            lib->programs = realloc(lib->programs, *capacity*sizeof(ShaderProgram));
+            if (lib->programs == NULL) abort();
+        }
+        sp = &lib->programs[lib->count++];
+        *sp = (ShaderProgram){.name = strndup(filename, base_len)};
+    }
+    sp->files = realloc(sp->files, (sp->file_count+1)*sizeof(char*));
+    if (sp->files == NULL) abort();
+    sp->files[sp->file_count++] = strdup(filename);
+}
+
+// group the shaders in dir into programs by base name and build them all.
+// archive may be NULL; if it has no shaders in dir they are read from disk.
+// returns the number of programs
+int shader_library_load(ShaderLibrary* lib, const Archive* archive, const char* dir) {
+    *lib = (ShaderLibrary){0};
+    lib->dir = strdup(dir);
+    int capacity = 0;
+    if (archive != NULL) {
+        for (int i=0; i<archive->count; i++) {
+            const char* filename = archive_dir_entry(archive, i, dir);
+            if (filename != NULL) shaderLibraryAdd(lib, filename, &capacity);
+        }
+        if (lib->count > 0) lib->archive = archive;
+    }
+    if (lib->archive == NULL) {
+        GError *err = NULL;
+        GDir* shadir = g_dir_open(dir, 0, &err);
+        if (err != NULL) {
+            fprintf(stderr, "Unable to list files in dir \"%s\": %s\n", dir, err->message);
+            g_error_free(err);
+            g_dir_close(shadir);
+            exit(1);
+        }
+        const char* filename;
+        while ((filename = g_dir_read_name(shadir)) != NULL) shaderLibraryAdd(lib, filename, &capacity);
         g_dir_close(shadir);
-        exit(1);
-    }
-
-    // Read filenames in dir and check extension
-    while (true) {
-        const char* filename = g_dir_read_name(shadir);
-        if (filename==NULL) { break; }
-        unsigned int shader_type;
-        const char* ext = fileExt(filename);
-        if (strcmp(ext,"vert") == 0) {
-            shader_type = GL_VERTEX_SHADER;
-        } else if (strcmp(ext,"frag") == 0) {
-            shader_type = GL_FRAGMENT_SHADER;
-        } else { continue; }
-
-        // If correct extension compile and link shader
-        char* full_path = malloc(strlen(shader_path)+strlen(filename)+2);
-        strcpy(full_path, shader_path);
-        if (shader_path[strlen(shader_path)-1] != '/') { 
-            full_path = strcat(full_path, "/");
+    }
+
+    if (lib->count == 0) return 0;
+
+    // directory order is arbitrary; sort so lookups and cache keys are stable
+    qsort(lib->programs, lib->count, sizeof(ShaderProgram), comparePrograms);
+    for (int i=0; i<lib->count; i++) {
+        qsort(lib->programs[i].files, lib->programs[i].file_count, sizeof(char*), compareNames);
+    }
+
+    lib->parallel = enableParallelCompile();
+    unsigned int built[lib->count];
+    ShaderTiming timings[lib->count];
+    buildPrograms(lib->archive, lib->dir, lib->programs, lib->count, lib->parallel, built, timings);
+    for (int i=0; i<lib->count; i++) {
+        lib->programs[i].program = built[i];
+        lib->programs[i].timing = timings[i];
+    }
+    return lib->count;
+}
+
+// handle of a program by name, or NULL. the handle stays valid for the
+// library's lifetime; its program is replaced in place on hot reload
+ShaderProgram* shader_find(ShaderLibrary* lib, const char* name) {
+    for (int i=0; i<lib->count; i++) {
+        if (strcmp(lib->programs[i].name, name) == 0) return &lib->programs[i];
+    }
+    return NULL;
+}
+
+void shader_library_report(ShaderLibrary* lib, FILE* out) {
+    fprintf(out, "Shaders in \"%s\"%s%s:\n", lib->dir, lib->archive ? " from the asset archive" : "",
+            lib->parallel ? ", compiled in parallel" : "");
+    for (int i=0; i<lib->count; i++) {
+        ShaderProgram* sp = &lib->programs[i];
+        if (sp->timing.from_cache) {
+            fprintf(out, "  %-10s %7.2f ms from cache\n", sp->name, sp->timing.ready_ms);
+        } else {
+            fprintf(out, "  %-10s %7.2f ms (compile %.2f ms, link %.2f ms issued)%s\n", sp->name, sp->timing.ready_ms,
+                    sp->timing.compile_ms, sp->timing.link_ms, sp->program ? "" : " FAILED");
+        }
+    }
+}
+
+void shader_library_free(ShaderLibrary* lib) {
+    for (int i=0; i<lib->count; i++) {
+        ShaderProgram* sp = &lib->programs[i];
+        if (sp->program != 0) {
+            glstate_forget_program(sp->program);
+            glDeleteProgram(sp->program);
         }
-        full_path = strcat(full_path, filename);
-        char* shader_source = readFile(full_path);
-        unsigned int shader = compileShader(shader_source, shader_type); // Pointer to compiled shader
-        
-        shaders[shader_count] = shader;
-        shader_count++;
+        for (int f=0; f<sp->file_count; f++) free(sp->files[f]);
+        free(sp->files);
+        free(sp->name);
     }
-    g_dir_close(shadir);
-    if (shaders[0] == 0) { return 0; }
-    shader_program = linkShaders(shader_count, shaders);
-    return shader_program;
+    free(lib->programs);
+    free(lib->dir);
+    *lib = (ShaderLibrary){0};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,12 @@
 #define SHAPES_H
 
 #include <glad/glad.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "archive.h"
+#include "glstate.h"
+#include "color.h"
 
 typedef struct VertexObject {
     unsigned int VBO, VAO, EBO; // Vertex Buffer, Vertex Array, Element Buffer
@@ -9,12 +15,130 @@ typedef struct VertexObject {
     unsigned int vert_count;
 } VertexObject;
 
+// Mesh registry. Shapes are looked up by a hash of their vertex and index
+// data, so identical geometry gets one set of GL buffers no matter how many
+// objects use it. Size, color and rotation belong to the Object drawing a
+// mesh, which lets every rectangle share the unit quad. The registry keeps
+// a CPU copy of each mesh and counts the GPU memory behind it.
+enum MeshLayout { MESH_COLOR, MESH_TEXTURED };
+
+typedef struct MeshEntry {
+    uint64_t hash;
+    enum MeshLayout layout;
+    VertexObject* vertobj;
+    float* vertices;
+    unsigned int* indices;
+    size_t vertices_size, indices_size;
+} MeshEntry;
+
+typedef struct MeshRegistry {
+    Pool vertobj_pool;
+    Arena* arena; // holds the CPU copies
+    MeshEntry* entries;
+    int count, capacity;
+    int requests;     // constructor calls, including those served from the registry
+    size_t gpu_bytes; // vertex, index and texture memory of every mesh
+} MeshRegistry;
+
+// arena space needed by a registry of capacity meshes whose vertex and
+// index data together take at most data_size bytes, plus rounding
+size_t mesh_registry_size(int capacity, size_t data_size) {
+    return pool_size(sizeof(VertexObject), capacity) + arena_round(capacity*sizeof(MeshEntry)) +
+           data_size + 2*capacity*ARENA_ALIGN;
+}
+
+void mesh_registry_init(MeshRegistry* reg, Arena* arena, int capacity) {
+    pool_init(&reg->vertobj_pool, arena, sizeof(VertexObject), capacity);
+    reg->entries = arena_alloc(arena, capacity*sizeof(MeshEntry));
+    reg->arena = arena;
+    reg->count = 0;
+    reg->capacity = capacity;
+    reg->requests = 0;
+    reg->gpu_bytes = 0;
+}
+
+// FNV-1a over the layout and the raw vertex and index data
+uint64_t mesh_hash(enum MeshLayout layout, const void* vertices, size_t vertices_size, const void* indices, size_t indices_size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    const unsigned char* parts[2] = {vertices, indices};
+    size_t sizes[2] = {vertices_size, indices_size};
+    h = (h ^ layout) * 0x100000001b3ull;
+    for (int p=0; p<2; p++) {
+        for (size_t i=0; i<sizes[p]; i++) h = (h ^ parts[p][i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// an existing mesh with exactly this data, or NULL
+VertexObject* mesh_find(MeshRegistry* reg, uint64_t hash, const float* vertices, size_t vertices_size, const unsigned int* indices, size_t indices_size) {
+    reg->requests++;
+    for (int i=0; i<reg->count; i++) {
+        MeshEntry* e = &reg->entries[i];
+        if (e->hash == hash && e->vertices_size == vertices_size && e->indices_size == indices_size &&
+            memcmp(e->vertices, vertices, vertices_size) == 0 && memcmp(e->indices, indices, indices_size) == 0)
+            return e->vertobj;
+    }
+    return NULL;
+}
+
+// record a new mesh; the caller creates its GL objects
+VertexObject* mesh_add(MeshRegistry* reg, uint64_t hash, enum MeshLayout layout, const float* vertices, size_t vertices_size, const unsigned int* indices, size_t indices_size) {
+    if (reg->count == reg->capacity) {
+        fprintf(stderr, "Mesh registry full: %d meshes\n", reg->capacity);
+        abort();
+    }
+    MeshEntry* e = &reg->entries[reg->count++];
+    e->hash = hash;
+    e->layout = layout;
+    e->vertobj = pool_alloc(&reg->vertobj_pool);
+    e->vertices = arena_alloc(reg->arena, vertices_size);
+    e->indices = arena_alloc(reg->arena, indices_size);
+    memcpy(e->vertices, vertices, vertices_size);
+    memcpy(e->indices, indices, indices_size);
+    e->vertices_size = vertices_size;
+    e->indices_size = indices_size;
+
+    e->vertobj->texture = 0;
+    e->vertobj->vert_count = indices_size/sizeof(unsigned int);
+    reg->gpu_bytes += vertices_size + indices_size;
+    return e->vertobj;
+}
+
+// CPU copy of a registered mesh's data
+MeshEntry* mesh_entry(MeshRegistry* reg, VertexObject* vertobj) {
+    for (int i=0; i<reg->count; i++) {
+        if (reg->entries[i].vertobj == vertobj) return &reg->entries[i];
+    }
+    return NULL;
+}
+
+void mesh_report(MeshRegistry* reg, FILE* out) {
+    fprintf(out, "Meshes: %d unique of %d requested, %.1f KiB of GPU buffers\n",
+            reg->count, reg->requests, reg->gpu_bytes/1024.0);
+}
+
+// delete every mesh's GL objects; the slots and CPU copies go with the arena
+void mesh_registry_release(MeshRegistry* reg) {
+    for (int i=0; i<reg->count; i++) {
+        MeshEntry* e = &reg->entries[i];
+        VertexObject* vertobj = e->vertobj;
+        if (glstate.vertex_array == vertobj->VAO) glstate_invalidate();
+        glDeleteVertexArrays(1, &vertobj->VAO);
+        glDeleteBuffers(1, &vertobj->VBO);
+        glDeleteBuffers(1, &vertobj->EBO);
+        if (vertobj->texture != 0) glDeleteTextures(1, &vertobj->texture);
+    }
+    reg->count = 0;
+    reg->requests = 0;
+    reg->gpu_bytes = 0;
+}
+
 void initVertArray(VertexObject* vertobj, float vertices[], unsigned int indices[], unsigned long vertices_size, unsigned long indices_size) {
     glGenVertexArrays(1, &vertobj->VAO);
     glGenBuffers(1, &vertobj->VBO);
     glGenBuffers(1, &vertobj->EBO);
 
-    glBindVertexArray(vertobj->VAO);
+    glstate_bind_vertex_array(vertobj->VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, vertobj->VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
@@ -30,7 +154,17 @@ void initVertArray(VertexObject* vertobj, float vertices[], unsigned int indices
     glEnableVertexAttribArray(1);
 }
 
-VertexObject* colorRect(float width, float height, vec3 color) {
+// a colored mesh from the registry, created on first use
+VertexObject* colorMesh(MeshRegistry* reg, float vertices[], unsigned int indices[], unsigned long vertices_size, unsigned long indices_size) {
+    uint64_t hash = mesh_hash(MESH_COLOR, vertices, vertices_size, indices, indices_size);
+    VertexObject* vertobj = mesh_find(reg, hash, vertices, vertices_size, indices, indices_size);
+    if (vertobj != NULL) return vertobj;
+    vertobj = mesh_add(reg, hash, MESH_COLOR, vertices, vertices_size, indices, indices_size);
+    initVertArray(vertobj, vertices, indices, vertices_size, indices_size);
+    return vertobj;
+}
+
+VertexObject* colorRect(MeshRegistry* reg, float width, float height, vec3 color) {
     // set up vertex data (and buffer(s)) and configure vertex attributes
     float vertices[] = {
         // positions             // colors         
@@ -44,14 +178,10 @@ VertexObject* colorRect(float width, float height, vec3 color) {
         1, 2, 3  // second triangle
     };
     
-    VertexObject* vertobj = malloc(sizeof(VertexObject));
-    vertobj->vert_count = sizeof(indices)/sizeof(unsigned int);
-    initVertArray(vertobj, vertices, indices, sizeof(vertices), sizeof(indices));
-    
-    return vertobj;
+    return colorMesh(reg, vertices, indices, sizeof(vertices), sizeof(indices));
 }
 
-VertexObject* colorRectOutline(float width, float height, float border, vec3 color) {
+VertexObject* colorRectOutline(MeshRegistry* reg, float width, float height, float border, vec3 color) {
     // set up vertex data (and buffer(s)) and configure vertex attributes
     float vertices[] = {
         // TOP
@@ -87,14 +217,10 @@ VertexObject* colorRectOutline(float width, float height, float border, vec3 col
 
     };
     
-    VertexObject* vertobj = malloc(sizeof(VertexObject));
-    vertobj->vert_count = sizeof(indices)/sizeof(unsigned int);
-    initVertArray(vertobj, vertices, indices, sizeof(vertices), sizeof(indices));
-    
-    return vertobj;
+    return colorMesh(reg, vertices, indices, sizeof(vertices), sizeof(indices));
 }
 
-VertexObject* colorDashedLine(float length, float width, int dashes, float spacing, vec3 color) {
+VertexObject* colorDashedLine(MeshRegistry* reg, float length, float width, int dashes, float spacing, vec3 color) {
     // set up vertex data (and buffer(s)) and configure vertex attributes
     float vertices[dashes*24];
     unsigned int indices[dashes*6];
@@ -121,15 +247,12 @@ VertexObject* colorDashedLine(float length, float width, int dashes, float spaci
         memcpy(indices+(i*6),   new_indices,  sizeof(new_indices));
     }
     
-    VertexObject* vertobj = malloc(sizeof(VertexObject));
-    vertobj->vert_count = sizeof(indices)/sizeof(unsigned int);
-    initVertArray(vertobj, vertices, indices, sizeof(vertices), sizeof(indices));
-    
-    return vertobj;
+    return colorMesh(reg, vertices, indices, sizeof(vertices), sizeof(indices));
 }
 
 
-VertexObject* textureRect() {
+// the image is looked up in assets first, which may be NULL
+VertexObject* textureRect(MeshRegistry* reg, const Archive* assets) {
     // set up vertex data (and buffer(s)) and configure vertex attributes
     float vertices[] = {
         // positions          // colors           // texture coords
@@ -143,13 +266,16 @@ VertexObject* textureRect() {
         1, 2, 3  // second triangle
     };
     
-    struct VertexObject* vertobj = malloc(sizeof(VertexObject));
+    uint64_t hash = mesh_hash(MESH_TEXTURED, vertices, sizeof(vertices), indices, sizeof(indices));
+    struct VertexObject* vertobj = mesh_find(reg, hash, vertices, sizeof(vertices), indices, sizeof(indices));
+    if (vertobj != NULL) return vertobj;
+    vertobj = mesh_add(reg, hash, MESH_TEXTURED, vertices, sizeof(vertices), indices, sizeof(indices));
 
     glGenVertexArrays(1, &vertobj->VAO);
     glGenBuffers(1, &vertobj->VBO);
     glGenBuffers(1, &vertobj->EBO);
 
-    glBindVertexArray(vertobj->VAO);
+    glstate_bind_vertex_array(vertobj->VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, vertobj->VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
@@ -169,7 +295,7 @@ VertexObject* textureRect() {
 
     // load and create a texture
     glGenTextures(1, &vertobj->texture);
-    glBindTexture(GL_TEXTURE_2D, vertobj->texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
+    glstate_bind_texture(vertobj->texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);  // set texture wrapping to GL_REPEAT (default wrapping method)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -179,10 +305,16 @@ VertexObject* textureRect() {
     
     // load image, create texture and generate mipmaps
     int width, height, nrChannels;
-    unsigned char *data = stbi_load("resources/textures/container.jpg", &width, &height, &nrChannels, 0);
+    Asset image;
+    unsigned char *data = NULL;
+    if (asset_load(assets, "resources/textures/container.jpg", &image)) {
+        data = stbi_load_from_memory((const stbi_uc*)image.data, image.size, &width, &height, &nrChannels, 0);
+        asset_release(&image);
+    }
     if (data) {
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        reg->gpu_bytes += (size_t)width*height*3*4/3; // with mipmaps
     } else {
         printf("Failed to load texture\n");
     }
@@ -191,4 +323,9 @@ VertexObject* textureRect() {
 }
 
 
+// the shared mesh behind every rectangle: size and color come from the Object
+VertexObject* unitQuad(MeshRegistry* reg) {
+    return colorRect(reg, 1.0f, 1.0f, WHITE);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef STREAM_H
+#define STREAM_H
+// Streaming buffer for data that changes every frame (instances, particles,
+// text). One GL buffer holds STREAM_FRAMES regions; each frame sub-allocates
+// vertex or index ranges from its own region, and a fence at the end of the
+// frame tells us when the GPU is done with that region so it can be
+// rewritten three frames later without stalling.
+//
+// With GL 4.4 or ARB_buffer_storage the buffer is persistently and
+// coherently mapped: callers write straight into GPU-visible memory and the
+// driver copies nothing. On plain GL 3.3 it falls back to orphaning: writes
+// go to a CPU staging area, are uploaded with glBufferSubData on flush, and
+// the storage is orphaned at the start of every frame so the driver never
+// waits for the GPU.
+#include <glad/glad.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "glstate.h"
+
+#define STREAM_FRAMES 3
+#define STREAM_ALIGN 16
+
+typedef struct StreamBuffer {
+    unsigned int buffer;
+    bool persistent;
+    size_t frame_size;      // bytes per frame region
+    unsigned char* mapped;  // all regions when persistent, the staging area otherwise
+    int frame;              // region being written
+    size_t head, flushed;   // bytes allocated and uploaded in the current region
+    bool orphan;            // orphaning: storage must be replaced before the next write
+    GLsync fences[STREAM_FRAMES];
+    unsigned int stalls;    // frames that had to wait for the GPU to release a region
+} StreamBuffer;
+
+static bool stream_has_buffer_storage() {
+    if (GLAD_GL_VERSION_4_4) return true;
+    if (!glstate_has_extension("GL_ARB_buffer_storage")) return false;
+    // glad only loads core entry points
+    if (glBufferStorage == NULL) glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glstate_get_proc("glBufferStorage");
+    return glBufferStorage != NULL;
+}
+
+static void stream_create(StreamBuffer* s) {
+    glGenBuffers(1, &s->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+    if (s->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, s->frame_size*STREAM_FRAMES, NULL, flags);
+        s->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, s->frame_size*STREAM_FRAMES, flags);
+        if (s->mapped == NULL) {
+            fprintf(stderr, "Failed to map stream buffer\n");
+            abort();
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, s->frame_size, NULL, GL_STREAM_DRAW);
+        s->mapped = malloc(s->frame_size);
+        if (s->mapped == NULL) abort();
+    }
+    s->frame = 0;
+    s->head = s->flushed = 0;
+    s->orphan = false;
+    for (int i=0; i<STREAM_FRAMES; i++) s->fences[i] = NULL;
+}
+
+static void stream_destroy(StreamBuffer* s) {
+    for (int i=0; i<STREAM_FRAMES; i++) {
+        if (s->fences[i]) glDeleteSync(s->fences[i]);
+    }
+    if (s->persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    } else {
+        free(s->mapped);
+    }
+    // GL keeps the storage alive until draws already issued from it complete
+    glDeleteBuffers(1, &s->buffer);
+}
+
+void stream_init(StreamBuffer* s, size_t frame_size) {
+    s->persistent = stream_has_buffer_storage();
+    s->frame_size = (frame_size + STREAM_ALIGN-1) & ~(size_t)(STREAM_ALIGN-1);
+    s->stalls = 0;
+    stream_create(s);
+}
+
+// reserve bytes in this frame's region. returns where to write them and,
+// through offset, where they start in s->buffer. the pointer is only valid
+// until the next stream_alloc, so write and stream_flush before allocating again
+void* stream_alloc(StreamBuffer* s, size_t bytes, size_t* offset) {
+    size_t start = (s->head + STREAM_ALIGN-1) & ~(size_t)(STREAM_ALIGN-1);
+    if (start + bytes > s->frame_size) {
+        // too much for one frame: replace the buffer with a bigger one
+        size_t size = s->frame_size*2;
+        while (size < bytes) size *= 2;
+        stream_destroy(s);
+        s->frame_size = size;
+        stream_create(s);
+        start = 0;
+    }
+    if (s->orphan) {
+        glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+        glBufferData(GL_ARRAY_BUFFER, s->frame_size, NULL, GL_STREAM_DRAW);
+        s->orphan = false;
+    }
+    s->head = start + bytes;
+    if (s->persistent) {
+        *offset = s->frame*s->frame_size + start;
+        return s->mapped + *offset;
+    }
+    s->flushed = start;
+    *offset = start;
+    return s->mapped + start;
+}
+
+// make everything written since the last flush visible to GL
+void stream_flush(StreamBuffer* s) {
+    if (s->persistent || s->head == s->flushed) return; // coherent mapping needs nothing
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, s->flushed, s->head - s->flushed, s->mapped + s->flushed);
+    s->flushed = s->head;
+}
+
+// fence this frame's region and move to the next, waiting if the GPU still reads it
+void stream_end_frame(StreamBuffer* s) {
+    s->head = s->flushed = 0;
+    if (!s->persistent) {
+        s->orphan = true;
+        return;
+    }
+    s->fences[s->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s->frame = (s->frame+1) % STREAM_FRAMES;
+
+    GLsync fence = s->fences[s->frame];
+    if (fence == NULL) return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        s->stalls++;
+        while (status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+    }
+    glDeleteSync(fence);
+    s->fences[s->frame] = NULL;
+}
+
+void stream_cleanup(StreamBuffer* s) {
+    stream_destroy(s);
+    s->buffer = 0;
+    s->mapped = NULL;
+}
+
+#endif
@@ -0,0 +1,475 @@
+#ifndef SWRASTER_H
+#define SWRASTER_H
+// CPU rasterizer backend, for machines whose GL is itself a software
+// renderer. It replaces GL's rasterization of the scene, not GL: the game
+// still needs a GL 3.3 context with its shaders and buffers, and the
+// finished frame reaches the window as one texture upload and a fullscreen
+// triangle drawn with the present shader. sw_backend hands it to render.h,
+// so render_objects and text_draw feed it while render_backend is set.
+//
+// Objects are drawn from the mesh registry's CPU copies and text from the
+// glyph atlas's CPU copy: every triangle is set up once in screen space as
+// three edge functions, binned into 64x64 pixel tiles, and the tiles are
+// shared out among a pool of threads. A tile is cleared and its triangles
+// rasterized in submission order, four pixels at a time with the xform.h
+// vector types, so blending stays correct without locks.
+//
+// Only filled triangles are drawn; the wireframe mode, mesh textures and
+// the batched rectangle path are GPU-only.
+#include <glad/glad.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cglm/cglm.h>
+
+#include "glstate.h"
+#include "render.h"
+#include "shader.h"
+#include "shapes.h"
+#include "text.h"
+#include "xform.h"
+
+#define SW_TILE 64
+#define SW_MAX_THREADS 16
+
+// a vertex in normalized device coordinates
+typedef struct SwVertex {
+    float x, y;
+    float r, g, b;
+    float u, v;
+} SwVertex;
+
+// single-channel coverage, multiplied into the vertex color's alpha
+typedef struct SwTexture {
+    const unsigned char* pixels;
+    int width, height;
+} SwTexture;
+
+typedef struct SwTriangle {
+    // edge i is opposite vertex i: w_i = a*x + b*y + c, positive inside
+    float a[3], b[3], c[3];
+    bool top_left[3]; // edges that own the pixels exactly on them
+    float inv_area;
+    float color[3][3];
+    float u[3], v[3];
+    const SwTexture* texture; // NULL for opaque
+    int x0, y0, x1, y1;       // pixel bounds, exclusive at the top end
+} SwTriangle;
+
+typedef struct SwBin {
+    int* triangles;
+    int count, capacity;
+} SwBin;
+
+typedef struct SwRaster {
+    int width, height;
+    uint32_t* pixels; // RGBA8, bottom row first like a GL texture
+    uint32_t clear;
+
+    SwTriangle* triangles;
+    int count, capacity;
+    SwBin* bins;
+    int tiles_x, tiles_y;
+
+    // workers wait for a new generation, then take tiles until none are left
+    pthread_t threads[SW_MAX_THREADS];
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long generation;
+    int busy;
+    bool quit;
+    atomic_int next_tile;
+
+    unsigned int texture, VAO; // presentation
+    int texture_width, texture_height;
+    SwTexture glyphs;
+    double raster_ms; // binning and rasterizing the last frame
+
+    // what the render.h entry points draw with, see sw_backend
+    RenderBackend backend;
+    MeshRegistry* meshes;
+    vec4* view_projection;
+    ShaderProgram* present;
+} SwRaster;
+
+static uint32_t sw_pack(float r, float g, float b) {
+    r = r < 0.0f ? 0.0f : r > 1.0f ? 1.0f : r;
+    g = g < 0.0f ? 0.0f : g > 1.0f ? 1.0f : g;
+    b = b < 0.0f ? 0.0f : b > 1.0f ? 1.0f : b;
+    return (uint32_t)(r*255.0f+0.5f) | (uint32_t)(g*255.0f+0.5f) << 8 | (uint32_t)(b*255.0f+0.5f) << 16 | 0xff000000u;
+}
+
+// bilinear, clamped to the edge, as the GL atlas texture is sampled
+static float sw_sample(const SwTexture* tex, float u, float v) {
+    float fu = u*tex->width - 0.5f, fv = v*tex->height - 0.5f;
+    int u0 = (int)floorf(fu), v0 = (int)floorf(fv);
+    float du = fu - u0, dv = fv - v0;
+    int u1 = u0+1 < tex->width ? u0+1 : tex->width-1, v1 = v0+1 < tex->height ? v0+1 : tex->height-1;
+    u0 = u0 < 0 ? 0 : u0 >= tex->width ? tex->width-1 : u0;
+    v0 = v0 < 0 ? 0 : v0 >= tex->height ? tex->height-1 : v0;
+    if (u1 < 0) u1 = 0;
+    if (v1 < 0) v1 = 0;
+    const unsigned char* row0 = tex->pixels + v0*tex->width;
+    const unsigned char* row1 = tex->pixels + v1*tex->width;
+    float top = row0[u0] + (row0[u1]-row0[u0])*du;
+    float bottom = row1[u0] + (row1[u1]-row1[u0])*du;
+    return (top + (bottom-top)*dv)/255.0f;
+}
+
+static void sw_tile(SwRaster* sw, int tile) {
+    int tx0 = (tile % sw->tiles_x)*SW_TILE, ty0 = (tile / sw->tiles_x)*SW_TILE;
+    int tx1 = tx0+SW_TILE < sw->width ? tx0+SW_TILE : sw->width;
+    int ty1 = ty0+SW_TILE < sw->height ? ty0+SW_TILE : sw->height;
+    for (int y=ty0; y<ty1; y++) {
+        uint32_t* row = sw->pixels + (size_t)y*sw->width;
+        for (int x=tx0; x<tx1; x++) row[x] = sw->clear;
+    }
+
+    SwBin* bin = &sw->bins[tile];
+    for (int t=0; t<bin->count; t++) {
+        const SwTriangle* tri = &sw->triangles[bin->triangles[t]];
+        int x0 = tri->x0 > tx0 ? tri->x0 : tx0, x1 = tri->x1 < tx1 ? tri->x1 : tx1;
+        int y0 = tri->y0 > ty0 ? tri->y0 : ty0, y1 = tri->y1 < ty1 ? tri->y1 : ty1;
+        xfloat4 lane = {0.5f, 1.5f, 2.5f, 3.5f};
+
+        for (int y=y0; y<y1; y++) {
+            uint32_t* row = sw->pixels + (size_t)y*sw->width;
+            float py = y+0.5f;
+            for (int x=x0; x<x1; x+=4) {
+                xfloat4 px = XSPLAT((float)x) + lane;
+                xint4 in = px < XSPLAT((float)x1);
+                xfloat4 w[3];
+                for (int e=0; e<3; e++) {
+                    w[e] = XSPLAT(tri->a[e])*px + XSPLAT(tri->b[e]*py + tri->c[e]);
+                    in &= tri->top_left[e] ? (w[e] >= XSPLAT(0.0f)) : (w[e] > XSPLAT(0.0f));
+                }
+                if (!(in[0] | in[1] | in[2] | in[3])) continue;
+
+                // barycentric weights, then every attribute for the four pixels
+                xfloat4 l0 = w[0]*XSPLAT(tri->inv_area), l1 = w[1]*XSPLAT(tri->inv_area), l2 = w[2]*XSPLAT(tri->inv_area);
+                xfloat4 rgb[3];
+                for (int ch=0; ch<3; ch++) {
+                    rgb[ch] = l0*XSPLAT(tri->color[0][ch]) + l1*XSPLAT(tri->color[1][ch]) + l2*XSPLAT(tri->color[2][ch]);
+                }
+                if (tri->texture == NULL) {
+                    for (int l=0; l<4; l++) {
+                        if (in[l]) row[x+l] = sw_pack(rgb[0][l], rgb[1][l], rgb[2][l]);
+                    }
+                    continue;
+                }
+
+                const SwTexture* tex = tri->texture;
+                xfloat4 u = l0*XSPLAT(tri->u[0]) + l1*XSPLAT(tri->u[1]) + l2*XSPLAT(tri->u[2]);
+                xfloat4 v = l0*XSPLAT(tri->v[0]) + l1*XSPLAT(tri->v[1]) + l2*XSPLAT(tri->v[2]);
+                for (int l=0; l<4; l++) {
+                    if (!in[l]) continue;
+                    float alpha = sw_sample(tex, u[l], v[l]);
+                    if (alpha == 0.0f) continue;
+                    uint32_t dst = row[x+l];
+                    float dr = (dst & 0xff)/255.0f, dg = (dst >> 8 & 0xff)/255.0f, db = (dst >> 16 & 0xff)/255.0f;
+                    row[x+l] = sw_pack(dr + (rgb[0][l]-dr)*alpha, dg + (rgb[1][l]-dg)*alpha, db + (rgb[2][l]-db)*alpha);
+                }
+            }
+        }
+    }
+}
+
+static void sw_run_tiles(SwRaster* sw) {
+    int tiles = sw->tiles_x*sw->tiles_y;
+    int tile;
+    while ((tile = atomic_fetch_add_explicit(&sw->next_tile, 1, memory_order_relaxed)) < tiles) {
+        sw_tile(sw, tile);
+    }
+}
+
+static void* sw_worker(void* arg) {
+    SwRaster* sw = arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&sw->lock);
+    while (true) {
+        while (!sw->quit && sw->generation == seen) pthread_cond_wait(&sw->start, &sw->lock);
+        if (sw->quit) break;
+        seen = sw->generation;
+        pthread_mutex_unlock(&sw->lock);
+
+        sw_run_tiles(sw);
+
+        pthread_mutex_lock(&sw->lock);
+        if (--sw->busy == 0) pthread_cond_signal(&sw->done);
+    }
+    pthread_mutex_unlock(&sw->lock);
+    return NULL;
+}
+
+void sw_resize(SwRaster* sw, int width, int height) {
+    int old_tiles = sw->tiles_x*sw->tiles_y;
+    sw->width = width > 0 ? width : 1;
+    sw->height = height > 0 ? height : 1;
+    sw->pixels = realloc(sw->pixels, (size_t)sw->width*sw->height*sizeof(uint32_t));
+    if (sw->pixels == NULL) abort();
+
+    sw->tiles_x = (sw->width+SW_TILE-1)/SW_TILE;
+    sw->tiles_y = (sw->height+SW_TILE-1)/SW_TILE;
+    for (int i=0; i<old_tiles; i++) free(sw->bins[i].triangles);
+    sw->bins = realloc(sw->bins, sw->tiles_x*sw->tiles_y*sizeof(SwBin));
+    if (sw->bins == NULL) abort();
+    memset(sw->bins, 0, sw->tiles_x*sw->tiles_y*sizeof(SwBin));
+}
+
+// threads <= 0 means one per online CPU, the calling thread included
+void sw_init(SwRaster* sw, int width, int height, int threads) {
+    *sw = (SwRaster){0};
+    sw_resize(sw, width, height);
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > SW_MAX_THREADS+1) threads = SW_MAX_THREADS+1;
+    pthread_mutex_init(&sw->lock, NULL);
+    pthread_cond_init(&sw->start, NULL);
+    pthread_cond_init(&sw->done, NULL);
+    atomic_init(&sw->next_tile, 0);
+    for (int i=0; i<threads-1; i++) {
+        if (pthread_create(&sw->threads[sw->thread_count], NULL, sw_worker, sw) != 0) {
+            fprintf(stderr, "Software renderer: failed to start worker %d\n", i);
+            break;
+        }
+        sw->thread_count++;
+    }
+    glGenVertexArrays(1, &sw->VAO); // the fullscreen triangle has no attributes
+}
+
+void sw_begin(SwRaster* sw, float r, float g, float b) {
+    sw->clear = sw_pack(r, g, b);
+    sw->count = 0;
+}
+
+// set up one triangle. either winding is drawn, like GL with culling off
+void sw_triangle(SwRaster* sw, const SwVertex* v0, const SwVertex* v1, const SwVertex* v2, const SwTexture* texture) {
+    const SwVertex* v[3] = {v0, v1, v2};
+    float sx[3], sy[3];
+    for (int i=0; i<3; i++) {
+        sx[i] = (v[i]->x*0.5f + 0.5f)*sw->width;
+        sy[i] = (v[i]->y*0.5f + 0.5f)*sw->height;
+    }
+    float area = (sx[1]-sx[0])*(sy[2]-sy[0]) - (sx[2]-sx[0])*(sy[1]-sy[0]);
+    if (area == 0.0f) return;
+    if (area < 0.0f) {
+        const SwVertex* t = v[1]; v[1] = v[2]; v[2] = t;
+        float tx = sx[1]; sx[1] = sx[2]; sx[2] = tx;
+        float ty = sy[1]; sy[1] = sy[2]; sy[2] = ty;
+        area = -area;
+    }
+
+    SwTriangle tri;
+    float minx = sx[0], maxx = sx[0], miny = sy[0], maxy = sy[0];
+    for (int i=0; i<3; i++) {
+        int j = (i+1)%3, k = (i+2)%3;
+        tri.a[i] = sy[j]-sy[k];
+        tri.b[i] = sx[k]-sx[j];
+        tri.c[i] = -(tri.a[i]*sx[j] + tri.b[i]*sy[j]);
+        tri.top_left[i] = tri.a[i] > 0.0f || (tri.a[i] == 0.0f && tri.b[i] < 0.0f);
+        tri.color[i][0] = v[i]->r;
+        tri.color[i][1] = v[i]->g;
+        tri.color[i][2] = v[i]->b;
+        tri.u[i] = v[i]->u;
+        tri.v[i] = v[i]->v;
+        if (sx[i] < minx) minx = sx[i];
+        if (sx[i] > maxx) maxx = sx[i];
+        if (sy[i] < miny) miny = sy[i];
+        if (sy[i] > maxy) maxy = sy[i];
+    }
+    tri.inv_area = 1.0f/area;
+    tri.texture = texture;
+    tri.x0 = minx > 0.0f ? (int)minx : 0;
+    tri.y0 = miny > 0.0f ? (int)miny : 0;
+    tri.x1 = maxx < sw->width ? (int)ceilf(maxx) : sw->width;
+    tri.y1 = maxy < sw->height ? (int)ceilf(maxy) : sw->height;
+    if (tri.x0 >= tri.x1 || tri.y0 >= tri.y1) return;
+
+    if (sw->count == sw->capacity) {
+        sw->capacity = sw->capacity ? sw->capacity*2 : 256;
+        sw->triangles = realloc(sw->triangles, sw->capacity*sizeof(SwTriangle));
+        if (sw->triangles == NULL) abort();
+    }
+    sw->triangles[sw->count++] = tri;
+}
+
+static double sw_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+// bin the frame's triangles and rasterize every tile
+void sw_flush(SwRaster* sw) {
+    double start = sw_clock_ms();
+    int tiles = sw->tiles_x*sw->tiles_y;
+    for (int i=0; i<tiles; i++) sw->bins[i].count = 0;
+    for (int t=0; t<sw->count; t++) {
+        SwTriangle* tri = &sw->triangles[t];
+        for (int ty=tri->y0/SW_TILE; ty<=(tri->y1-1)/SW_TILE; ty++) {
+            for (int tx=tri->x0/SW_TILE; tx<=(tri->x1-1)/SW_TILE; tx++) {
+                SwBin* bin = &sw->bins[ty*sw->tiles_x + tx];
+                if (bin->count == bin->capacity) {
+                    bin->capacity = bin->capacity ? bin->capacity*2 : 16;
+                    bin->triangles = realloc(bin->triangles, bin->capacity*sizeof(int));
+                    if (bin->triangles == NULL) abort();
+                }
+                bin->triangles[bin->count++] = t;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&sw->lock);
+    atomic_store_explicit(&sw->next_tile, 0, memory_order_relaxed);
+    sw->busy = sw->thread_count;
+    sw->generation++;
+    pthread_cond_broadcast(&sw->start);
+    pthread_mutex_unlock(&sw->lock);
+
+    sw_run_tiles(sw);
+
+    pthread_mutex_lock(&sw->lock);
+    while (sw->busy > 0) pthread_cond_wait(&sw->done, &sw->lock);
+    pthread_mutex_unlock(&sw->lock);
+    sw->raster_ms = sw_clock_ms() - start;
+}
+
+// the same scene render_objects draws, from the registry's copies of the meshes
+void sw_draw_objects(SwRaster* sw, MeshRegistry* reg, Object* objects, int count, mat4 view_projection) {
+    float x[count], y[count], rot[count], xscale[count], yscale[count];
+    Xform2D xforms[count];
+    for (int i=0; i<count; i++) {
+        x[i] = objects[i].xpos;
+        y[i] = objects[i].ypos;
+        rot[i] = objects[i].rot;
+        xscale[i] = objects[i].xscale;
+        yscale[i] = objects[i].yscale;
+    }
+    xform_batch(x, y, rot, xscale, yscale, count, xforms, sizeof(Xform2D));
+
+    for (int i=0; i<count; i++) {
+        MeshEntry* e = mesh_entry(reg, objects[i].vertobj);
+        if (e == NULL) continue;
+        int stride = e->layout == MESH_TEXTURED ? 8 : 6;
+        int vertex_count = e->vertices_size/(stride*sizeof(float));
+        SwVertex vertices[vertex_count];
+        Xform2D* t = &xforms[i];
+        for (int k=0; k<vertex_count; k++) {
+            const float* src = e->vertices + k*stride;
+            float wx = t->x + src[0]*t->ax + src[1]*t->bx;
+            float wy = t->y + src[0]*t->ay + src[1]*t->by;
+            float w = view_projection[0][3]*wx + view_projection[1][3]*wy + view_projection[3][3];
+            vertices[k] = (SwVertex){
+                (view_projection[0][0]*wx + view_projection[1][0]*wy + view_projection[3][0])/w,
+                (view_projection[0][1]*wx + view_projection[1][1]*wy + view_projection[3][1])/w,
+                src[3]*objects[i].color[0], src[4]*objects[i].color[1], src[5]*objects[i].color[2],
+                0.0f, 0.0f,
+            };
+        }
+        unsigned int index_count = e->indices_size/sizeof(unsigned int);
+        for (unsigned int k=0; k+2<index_count; k+=3) {
+            sw_triangle(sw, &vertices[e->indices[k]], &vertices[e->indices[k+1]], &vertices[e->indices[k+2]], NULL);
+        }
+    }
+}
+
+// the same glyph quads text_draw draws, blended over the scene
+void sw_draw_text(SwRaster* sw, GlyphAtlas* atlas, TextMesh** meshes, int count, mat4 view_projection) {
+    sw->glyphs = (SwTexture){atlas->pixels, atlas->width, atlas->height};
+    if (sw->glyphs.pixels == NULL) return;
+    for (int i=0; i<count; i++) {
+        const float* src = meshes[i]->vertices;
+        for (int g=0; g<meshes[i]->glyph_count; g++, src += TEXT_GLYPH_FLOATS) {
+            SwVertex v[6];
+            for (int k=0; k<6; k++) {
+                const float* p = src + k*TEXT_VERTEX_FLOATS;
+                v[k] = (SwVertex){
+                    view_projection[0][0]*p[0] + view_projection[1][0]*p[1] + view_projection[3][0],
+                    view_projection[0][1]*p[0] + view_projection[1][1]*p[1] + view_projection[3][1],
+                    p[4], p[5], p[6], p[2], p[3],
+                };
+            }
+            sw_triangle(sw, &v[0], &v[1], &v[2], &sw->glyphs);
+            sw_triangle(sw, &v[3], &v[4], &v[5], &sw->glyphs);
+        }
+    }
+}
+
+// copy the frame into the window with program, which samples one texture
+// over a fullscreen triangle
+void sw_present(SwRaster* sw, unsigned int shader_program) {
+    if (sw->texture == 0) glGenTextures(1, &sw->texture);
+    glstate_bind_texture(sw->texture);
+    if (sw->texture_width != sw->width || sw->texture_height != sw->height) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, sw->width, sw->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, sw->pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        sw->texture_width = sw->width;
+        sw->texture_height = sw->height;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sw->width, sw->height, GL_RGBA, GL_UNSIGNED_BYTE, sw->pixels);
+    }
+    glstate_use_program(shader_program);
+    glstate_polygon_mode(GL_FILL);
+    glstate_bind_vertex_array(sw->VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+static void sw_backend_begin(void* self, float r, float g, float b) {
+    sw_begin(self, r, g, b);
+}
+
+static void sw_backend_objects(void* self, Object* objects, int count) {
+    SwRaster* sw = self;
+    sw_draw_objects(sw, sw->meshes, objects, count, sw->view_projection);
+}
+
+static void sw_backend_text(void* self, GlyphAtlas* atlas, TextMesh** meshes, int count) {
+    SwRaster* sw = self;
+    sw_draw_text(sw, atlas, meshes, count, sw->view_projection);
+}
+
+static void sw_backend_end(void* self) {
+    SwRaster* sw = self;
+    sw_flush(sw);
+    sw_present(sw, sw->present->program);
+}
+
+// the backend for render_backend. meshes, view_projection and the present
+// program are read every frame, so they must outlive it
+RenderBackend* sw_backend(SwRaster* sw, MeshRegistry* meshes, mat4 view_projection, ShaderProgram* present) {
+    sw->meshes = meshes;
+    sw->view_projection = view_projection;
+    sw->present = present;
+    sw->backend = (RenderBackend){sw, sw_backend_begin, sw_backend_objects, sw_backend_text, sw_backend_end};
+    return &sw->backend;
+}
+
+void sw_cleanup(SwRaster* sw) {
+    pthread_mutex_lock(&sw->lock);
+    sw->quit = true;
+    pthread_cond_broadcast(&sw->start);
+    pthread_mutex_unlock(&sw->lock);
+    for (int i=0; i<sw->thread_count; i++) pthread_join(sw->threads[i], NULL);
+    pthread_mutex_destroy(&sw->lock);
+    pthread_cond_destroy(&sw->start);
+    pthread_cond_destroy(&sw->done);
+
+    if (glstate.vertex_array == sw->VAO || glstate.texture == sw->texture) glstate_invalidate();
+    glDeleteVertexArrays(1, &sw->VAO);
+    if (sw->texture != 0) glDeleteTextures(1, &sw->texture);
+    for (int i=0; i<sw->tiles_x*sw->tiles_y; i++) free(sw->bins[i].triangles);
+    free(sw->bins);
+    free(sw->triangles);
+    free(sw->pixels);
+}
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef TEXT_H
+#define TEXT_H
+// Text rendering. Printable ASCII is rasterized once with FreeType and
+// packed into a single-channel atlas texture. A TextMesh keeps the glyph
+// quads of one string and only rebuilds them when the string changes, so a
+// score costs nothing until it increments. Every frame text_draw copies the
+// quads of all visible meshes into the stream and draws them with one call.
+#include <glad/glad.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+#include "archive.h"
+#include "glstate.h"
+#include "render.h"
+#include "stream.h"
+
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+#define GLYPH_COUNT (GLYPH_LAST-GLYPH_FIRST+1)
+#define ATLAS_WIDTH 512
+#define ATLAS_PADDING 1
+
+// x, y, u, v, r, g, b per vertex, six vertices per glyph
+#define TEXT_VERTEX_FLOATS 7
+#define TEXT_GLYPH_FLOATS (6*TEXT_VERTEX_FLOATS)
+
+enum TextAlign { TEXT_LEFT, TEXT_CENTER, TEXT_RIGHT };
+
+typedef struct Glyph {
+    float u0, v0, u1, v1;     // atlas rectangle
+    int width, height;        // bitmap size in pixels
+    int bearing_x, bearing_y; // pen to top left of the bitmap
+    int advance;              // pixels
+} Glyph;
+
+typedef struct GlyphAtlas {
+    unsigned int texture;
+    int width, height;
+    int pixel_size;
+    unsigned char* pixels; // CPU copy for the software renderer
+    Glyph glyphs[GLYPH_COUNT];
+} GlyphAtlas;
+
+typedef struct TextMesh {
+    char* text;
+    float x, y, size; // anchor on the baseline, em height in world units
+    enum TextAlign align;
+    vec3 color;
+    float* vertices;
+    int glyph_count, capacity;
+} TextMesh;
+
+typedef struct TextRenderer {
+    unsigned int VAO;
+    StreamBuffer* stream;
+    GlyphAtlas atlas;
+} TextRenderer;
+
+// rasterize printable ASCII from the font file in memory and pack it into one texture
+bool atlas_load(GlyphAtlas* atlas, const Asset* font, int pixel_size) {
+    FT_Library ft;
+    FT_Face face;
+    if (FT_Init_FreeType(&ft)) {
+        fprintf(stderr, "Failed to initialize FreeType\n");
+        return false;
+    }
+    if (FT_New_Memory_Face(ft, (const FT_Byte*)font->data, font->size, 0, &face)) {
+        fprintf(stderr, "Failed to load font\n");
+        FT_Done_FreeType(ft);
+        return false;
+    }
+    FT_Set_Pixel_Sizes(face, 0, pixel_size);
+    atlas->pixel_size = pixel_size;
+
+    // shelf packing: glyphs left to right, a new row when one is full
+    int pos_x[GLYPH_COUNT], pos_y[GLYPH_COUNT];
+    int x = ATLAS_PADDING, y = ATLAS_PADDING, row_height = 0;
+    for (int c=GLYPH_FIRST; c<=GLYPH_LAST; c++) {
+        Glyph* g = &atlas->glyphs[c-GLYPH_FIRST];
+        if (FT_Load_Char(face, c, FT_LOAD_DEFAULT)) {
+            *g = (Glyph){0};
+            pos_x[c-GLYPH_FIRST] = pos_y[c-GLYPH_FIRST] = 0;
+            continue;
+        }
+        FT_GlyphSlot slot = face->glyph;
+        g->width = slot->metrics.width >> 6;
+        g->height = slot->metrics.height >> 6;
+        g->bearing_x = slot->metrics.horiBearingX >> 6;
+        g->bearing_y = slot->metrics.horiBearingY >> 6;
+        g->advance = slot->advance.x >> 6;
+        if (x + g->width + ATLAS_PADDING > ATLAS_WIDTH) {
+            x = ATLAS_PADDING;
+            y += row_height + ATLAS_PADDING;
+            row_height = 0;
+        }
+        pos_x[c-GLYPH_FIRST] = x;
+        pos_y[c-GLYPH_FIRST] = y;
+        x += g->width + ATLAS_PADDING;
+        if (g->height > row_height) row_height = g->height;
+    }
+    atlas->width = ATLAS_WIDTH;
+    atlas->height = 1;
+    while (atlas->height < y + row_height + ATLAS_PADDING) atlas->height *= 2;
+
+    unsigned char* pixels = calloc(atlas->width, atlas->height);
+    if (pixels == NULL) abort();
+    for (int c=GLYPH_FIRST; c<=GLYPH_LAST; c++) {
+        Glyph* g = &atlas->glyphs[c-GLYPH_FIRST];
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) continue;
+        FT_Bitmap* bitmap = &face->glyph->bitmap;
+        int gx = pos_x[c-GLYPH_FIRST], gy = pos_y[c-GLYPH_FIRST];
+        // the rendered bitmap can differ from the metrics by a pixel
+        g->width = bitmap->width;
+        g->height = bitmap->rows;
+        g->bearing_x = face->glyph->bitmap_left;
+        g->bearing_y = face->glyph->bitmap_top;
+        for (unsigned int row=0; row<bitmap->rows && gy+row<(unsigned int)atlas->height; row++) {
+            int w = bitmap->width;
+            if (gx + w > atlas->width) w = atlas->width - gx;
+            memcpy(pixels + (gy+row)*atlas->width + gx, bitmap->buffer + row*bitmap->pitch, w);
+        }
+        g->u0 = gx/(float)atlas->width;
+        g->v0 = gy/(float)atlas->height;
+        g->u1 = (gx+g->width)/(float)atlas->width;
+        g->v1 = (gy+g->height)/(float)atlas->height;
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(ft);
+
+    glGenTextures(1, &atlas->texture);
+    glstate_bind_texture(atlas->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas->width, atlas->height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    atlas->pixels = pixels;
+    return true;
+}
+
+void text_init(TextMesh* mesh, float x, float y, float size, enum TextAlign align, vec3 color) {
+    *mesh = (TextMesh){.x = x, .y = y, .size = size, .align = align};
+    memcpy(mesh->color, color, sizeof(vec3));
+}
+
+// set the string shown by mesh, rebuilding its quads only if it changed
+bool text_set(TextMesh* mesh, GlyphAtlas* atlas, const char* text) {
+    if (mesh->text != NULL && strcmp(mesh->text, text) == 0) return false;
+    free(mesh->text);
+    mesh->text = strdup(text);
+    if (mesh->text == NULL) abort();
+
+    int len = strlen(text);
+    if (len > mesh->capacity) {
+        mesh->vertices = realloc(mesh->vertices, len*TEXT_GLYPH_FLOATS*sizeof(float));
+        if (mesh->vertices == NULL) abort();
+        mesh->capacity = len;
+    }
+
+    float scale = mesh->size/atlas->pixel_size;
+    int width = 0;
+    for (int i=0; i<len; i++) {
+        unsigned char c = text[i];
+        if (c >= GLYPH_FIRST && c <= GLYPH_LAST) width += atlas->glyphs[c-GLYPH_FIRST].advance;
+    }
+    float pen = mesh->x;
+    if (mesh->align == TEXT_CENTER) pen -= width*scale/2.0f;
+    if (mesh->align == TEXT_RIGHT) pen -= width*scale;
+
+    float* v = mesh->vertices;
+    mesh->glyph_count = 0;
+    for (int i=0; i<len; i++) {
+        unsigned char c = text[i];
+        if (c < GLYPH_FIRST || c > GLYPH_LAST) continue;
+        Glyph* g = &atlas->glyphs[c-GLYPH_FIRST];
+        if (g->width > 0 && g->height > 0) {
+            float x0 = pen + g->bearing_x*scale, x1 = x0 + g->width*scale;
+            float y1 = mesh->y + g->bearing_y*scale, y0 = y1 - g->height*scale;
+            float r = mesh->color[0], gr = mesh->color[1], b = mesh->color[2];
+            float quad[TEXT_GLYPH_FLOATS] = {
+                // positions  // atlas      // colors
+                x0, y1,       g->u0, g->v0, r, gr, b, // top left
+                x0, y0,       g->u0, g->v1, r, gr, b, // bottom left
+                x1, y0,       g->u1, g->v1, r, gr, b, // bottom right
+                x0, y1,       g->u0, g->v0, r, gr, b, // top left
+                x1, y0,       g->u1, g->v1, r, gr, b, // bottom right
+                x1, y1,       g->u1, g->v0, r, gr, b, // top right
+            };
+            memcpy(v, quad, sizeof(quad));
+            v += TEXT_GLYPH_FLOATS;
+            mesh->glyph_count++;
+        }
+        pen += g->advance*scale;
+    }
+    return true;
+}
+
+void text_free(TextMesh* mesh) {
+    free(mesh->text);
+    free(mesh->vertices);
+    mesh->text = NULL;
+    mesh->vertices = NULL;
+    mesh->glyph_count = mesh->capacity = 0;
+}
+
+// font_path is looked up in assets first, which may be NULL
+bool text_renderer_init(TextRenderer* tr, StreamBuffer* stream, const Archive* assets, const char* font_path, int pixel_size) {
+    tr->stream = stream;
+    Asset font;
+    if (!asset_load(assets, font_path, &font)) {
+        fprintf(stderr, "Failed to read font \"%s\"\n", font_path);
+        return false;
+    }
+    bool loaded = atlas_load(&tr->atlas, &font, pixel_size);
+    asset_release(&font); // FreeType is done with it once the atlas is built
+    if (!loaded) return false;
+
+    glGenVertexArrays(1, &tr->VAO);
+    glstate_bind_vertex_array(tr->VAO);
+    // position, atlas coordinate and color attributes. they point into the
+    // stream at draw time
+    for (int i=0; i<3; i++) glEnableVertexAttribArray(i);
+    glstate_bind_vertex_array(0);
+    return true;
+}
+
+// draw every mesh in one call; the view-projection comes from the Camera uniform block
+void text_draw(TextRenderer* tr, TextMesh** meshes, int count, unsigned int shader_program) {
+    if (render_backend != NULL) {
+        render_backend->text(render_backend->self, &tr->atlas, meshes, count);
+        return;
+    }
+    int glyphs = 0;
+    for (int i=0; i<count; i++) glyphs += meshes[i]->glyph_count;
+    if (glyphs == 0) return;
+
+    size_t offset;
+    float* dst = stream_alloc(tr->stream, glyphs*TEXT_GLYPH_FLOATS*sizeof(float), &offset);
+    for (int i=0; i<count; i++) {
+        memcpy(dst, meshes[i]->vertices, meshes[i]->glyph_count*TEXT_GLYPH_FLOATS*sizeof(float));
+        dst += meshes[i]->glyph_count*TEXT_GLYPH_FLOATS;
+    }
+    stream_flush(tr->stream);
+
+    glstate_use_program(shader_program);
+    glstate_polygon_mode(GL_FILL);
+    glstate_bind_texture(tr->atlas.texture);
+    glstate_bind_vertex_array(tr->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, tr->stream->buffer);
+    size_t stride = TEXT_VERTEX_FLOATS*sizeof(float);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset + 2*sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + 4*sizeof(float)));
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, glyphs*6);
+    glDisable(GL_BLEND);
+}
+
+void text_renderer_cleanup(TextRenderer* tr) {
+    if (glstate.vertex_array == tr->VAO || glstate.texture == tr->atlas.texture) glstate_invalidate();
+    glDeleteVertexArrays(1, &tr->VAO);
+    glDeleteTextures(1, &tr->atlas.texture);
+    free(tr->atlas.pixels);
+    tr->atlas.pixels = NULL;
+}
+
+#endif
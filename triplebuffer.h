@@ -0,0 +1,63 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+// Lock-free triple buffer handing the latest of a stream of values from one
+// writer thread to one reader thread. The writer fills its back slot and
+// swaps it with the shared middle slot; the reader swaps its front slot with
+// the middle one when a newer value has arrived. Neither side ever waits for
+// the other, the reader always sees a complete value, and values published
+// faster than the reader takes them are skipped.
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRIPLE_FRESH 4u // set in middle while it holds a value the reader has not taken
+
+typedef struct TripleBuffer {
+    unsigned char* slots; // three values of size bytes
+    size_t size;
+    _Atomic unsigned int middle; // slot index, or'ed with TRIPLE_FRESH
+    unsigned int back;           // writer's slot
+    unsigned int front;          // reader's slot
+} TripleBuffer;
+
+void triple_init(TripleBuffer* tb, size_t size) {
+    tb->slots = calloc(3, size);
+    if (tb->slots == NULL) abort();
+    tb->size = size;
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+}
+
+// the slot the writer fills next
+void* triple_back(TripleBuffer* tb) {
+    return tb->slots + tb->back*tb->size;
+}
+
+// hand the back slot to the reader
+void triple_publish(TripleBuffer* tb) {
+    unsigned int old = atomic_exchange_explicit(&tb->middle, tb->back | TRIPLE_FRESH, memory_order_acq_rel);
+    tb->back = old & ~TRIPLE_FRESH;
+}
+
+// take the newest published value if there is one; false when the front
+// slot is already the newest
+bool triple_acquire(TripleBuffer* tb) {
+    if (!(atomic_load_explicit(&tb->middle, memory_order_relaxed) & TRIPLE_FRESH)) return false;
+    unsigned int old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+    tb->front = old & ~TRIPLE_FRESH;
+    return true;
+}
+
+// the reader's value, unchanged until the next triple_acquire
+const void* triple_front(const TripleBuffer* tb) {
+    return tb->slots + tb->front*tb->size;
+}
+
+void triple_cleanup(TripleBuffer* tb) {
+    free(tb->slots);
+    tb->slots = NULL;
+}
+
+#endif